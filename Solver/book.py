@@ -0,0 +1,211 @@
+import bisect
+import hashlib
+import mmap
+import os
+import struct
+import sys
+import typing
+from dataclasses import dataclass
+from .solver_node import SolverNode
+from .symmetry import INVERSE_SYMMETRY, TRANSFORM_TABLES, canonical_position, coords_to_index, index_to_coords
+from .types import BoardState
+from .utils import get_stone_player
+
+MAGIC = b"C6BOOK01"
+HEADER = struct.Struct("<8sQ")  # magic, number of entries
+RECORD = struct.Struct("<BBHH")  # state, number of stones, stones as point indices in the canonical orientation
+NO_STONE = 0xFFFF
+
+
+@dataclass
+class BookEntry:
+    state: BoardState
+    # the rest of the winning turn of the side to move, empty if it loses or the move is unknown
+    stones: typing.List[str]
+
+
+def position_hash(moves: typing.Iterable[typing.Tuple[str, str]]) -> typing.Tuple[int, int]:
+    """Return the 64-bit hash of the canonical position of `moves` and the symmetry mapping onto it."""
+    key, symmetry = canonical_position(moves)
+    return int.from_bytes(hashlib.blake2b(key.encode(), digest_size=8).digest(), "little"), symmetry
+
+
+class OpeningBook:
+    """
+    Solved positions from a book file written by `OpeningBookBuilder`, memory-mapped.
+
+    Entries are keyed by the hash of the canonical position (see `canonical_position`), so
+    symmetric positions and transpositions share one entry, and winning stones are stored in the
+    canonical orientation. The file holds a header, the sorted hashes and one record per hash;
+    lookups binary-search the mapped hashes in place, so opening a book reads nothing up front.
+    """
+
+    def __init__(self, path: str):
+        self.path = path
+        self.hits = 0
+        self.misses = 0
+        self._file = open(path, "rb")
+        size = os.fstat(self._file.fileno()).st_size
+        if size < HEADER.size:
+            self._file.close()
+            raise ValueError(f"{path} is not an opening book")
+        self._map = mmap.mmap(self._file.fileno(), 0, access=mmap.ACCESS_READ)
+        magic, count = HEADER.unpack_from(self._map)
+        if magic != MAGIC or size != HEADER.size + count * (8 + RECORD.size):
+            self._map.close()
+            self._file.close()
+            raise ValueError(f"{path} is not an opening book")
+        self._count = count
+        self._records = HEADER.size + 8 * count
+        if sys.byteorder == "little":
+            self._hashes: typing.Sequence[int] = memoryview(self._map)[HEADER.size:self._records].cast("Q")
+        else:
+            self._hashes = struct.unpack_from(f"<{count}Q", self._map, HEADER.size)
+
+    def __len__(self) -> int:
+        return self._count
+
+    def lookup(self, moves: typing.Sequence[typing.Tuple[str, str]]) -> typing.Optional[BookEntry]:
+        """Return the entry of the position reached by `moves`, with its stones in that orientation."""
+        key, symmetry = position_hash(moves)
+        i = bisect.bisect_left(self._hashes, key)
+        if i == self._count or self._hashes[i] != key:
+            self.misses += 1
+            return None
+        self.hits += 1
+        state, stones = self._record(i)
+        inverse = TRANSFORM_TABLES[INVERSE_SYMMETRY[symmetry]]
+        return BookEntry(state, [index_to_coords(inverse[point]) for point in stones])
+
+    def items(self) -> typing.Iterator[typing.Tuple[int, BoardState, typing.Tuple[int, ...]]]:
+        """Yield (hash, state, stones in the canonical orientation) for every entry."""
+        for i in range(self._count):
+            yield (self._hashes[i],) + self._record(i)
+
+    def close(self):
+        if isinstance(self._hashes, memoryview):
+            self._hashes.release()
+        self._map.close()
+        self._file.close()
+
+    def _record(self, i: int) -> typing.Tuple[BoardState, typing.Tuple[int, ...]]:
+        state, num_stones, first, second = RECORD.unpack_from(self._map, self._records + i * RECORD.size)
+        return BoardState(state), (first, second)[:num_stones]
+
+
+class OpeningBookBuilder:
+    """
+    Collects the solved positions of solver trees, with the winning stones of the side to move, and
+    writes them to a book file for `OpeningBook`. The first entry added for a position is kept.
+
+    A node is solved if its `status` is `BLACK_WIN` or `WHITE_WIN`, or, for trees read from SGF
+    files, if its `RE` property starts with `B+` or `W+`. Only results backed by the node itself are
+    added: an engine verdict on a leaf, a win through a child solved the same way, or a loss every
+    child of which is lost too. Anything else, e.g. a status written onto the node from elsewhere,
+    is skipped.
+    """
+
+    def __init__(self):
+        self.entries: typing.Dict[int, typing.Tuple[BoardState, typing.Tuple[int, ...]]] = {}
+
+    def __len__(self) -> int:
+        return len(self.entries)
+
+    def add_book(self, book: OpeningBook):
+        for key, state, stones in book.items():
+            self.entries.setdefault(key, (state, stones))
+
+    def add_position(self, moves: typing.Sequence[typing.Tuple[str, str]], state: BoardState, stones: typing.Sequence[str] = ()):
+        """Add the position reached by `moves`, with `stones` winning it for the side to move."""
+        key, symmetry = position_hash(moves)
+        table = TRANSFORM_TABLES[symmetry]
+        self.entries.setdefault(key, (state, tuple(table[coords_to_index(coords)] for coords in stones[:2])))
+
+    def add_tree(self, root: SolverNode) -> int:
+        """
+        Add every solved node of the subtree of `root`, e.g. the job node of a solver, and return
+        the number of solved nodes added. The moves above `root` are part of its positions.
+        """
+        solved = 0
+        moves: typing.List[typing.Tuple[str, str]] = []
+        ancestor = root.parent
+        while ancestor is not None:
+            move = self._move(ancestor)
+            if move is not None:
+                moves.append(move)
+            ancestor = ancestor.parent
+        moves.reverse()
+        stack = [(root, len(moves))]
+        while stack:
+            node, depth = stack.pop()
+            del moves[depth:]
+            move = self._move(node)
+            if move is not None:
+                moves.append(move)
+            state = self._state(node)
+            if state != BoardState.UNKNOWN and self._derived(node, state, len(moves)):
+                solved += 1
+                self.add_position(moves, state, self._winning_stones(node, state, len(moves)))
+            children = list(node.get_children_iter())
+            stack.extend((child, len(moves)) for child in reversed(children))
+        return solved
+
+    def write(self, path: str):
+        """Write the book to `path` through a temporary file, so that readers never see a partial book."""
+        keys = sorted(self.entries)
+        temporary = path + ".tmp"
+        with open(temporary, "wb") as f:
+            f.write(HEADER.pack(MAGIC, len(keys)))
+            f.write(struct.pack(f"<{len(keys)}Q", *keys))
+            for key in keys:
+                state, stones = self.entries[key]
+                padded = stones + (NO_STONE,) * (2 - len(stones))
+                f.write(RECORD.pack(state.value, len(stones), *padded))
+        os.replace(temporary, path)
+
+    @staticmethod
+    def _move(node: SolverNode) -> typing.Optional[typing.Tuple[str, str]]:
+        for player in ("B", "W"):
+            if player in node:
+                return player, node[player][0]
+        return None
+
+    @staticmethod
+    def _state(node: SolverNode) -> BoardState:
+        status = getattr(node, "status", BoardState.UNKNOWN)
+        if status != BoardState.UNKNOWN:
+            return status
+        result = node["RE"][0] if "RE" in node else ""
+        if result.startswith("B+"):
+            return BoardState.BLACK_WIN
+        if result.startswith("W+"):
+            return BoardState.WHITE_WIN
+        return BoardState.UNKNOWN
+
+    @classmethod
+    def _derived(cls, node: SolverNode, state: BoardState, num_stones: int) -> bool:
+        """Whether `state` follows from `node` itself: a leaf, or its children as in `_winning_stones`."""
+        if node.child is None:
+            return True
+        side = get_stone_player(num_stones)
+        if state == (BoardState.BLACK_WIN if side == "B" else BoardState.WHITE_WIN):
+            return any(cls._state(child) == state for child in node.get_children_iter())
+        return all(cls._state(child) == state for child in node.get_children_iter())
+
+    @classmethod
+    def _winning_stones(cls, node: SolverNode, state: BoardState, num_stones: int) -> typing.List[str]:
+        """Follow the children solved the same way for the rest of the turn of the side to move."""
+        side = get_stone_player(num_stones)
+        if state != (BoardState.BLACK_WIN if side == "B" else BoardState.WHITE_WIN):
+            return []
+        stones: typing.List[str] = []
+        while len(stones) < 2 and get_stone_player(num_stones + len(stones)) == side:
+            for child in node.get_children_iter():
+                move = cls._move(child)
+                if move is not None and move[0] == side and cls._state(child) == state:
+                    stones.append(move[1])
+                    node = child
+                    break
+            else:
+                break
+        return stones
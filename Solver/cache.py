@@ -0,0 +1,102 @@
+import hashlib
+import json
+import os
+import typing
+from collections import OrderedDict
+
+
+class EvaluationCache:
+    """
+    Cache of raw engine outputs keyed by the job and its `-ignore` set.
+
+    Lookups go to an in-memory LRU tier first. If `path` is given, every new entry is also
+    appended to that file, and the file is indexed again when the cache is created, so results
+    survive restarts. Only the file offsets of the on-disk tier are kept in memory.
+    """
+
+    def __init__(self, path: typing.Optional[str] = None, capacity: int = 1 << 16):
+        self.path = path
+        self.capacity = capacity
+        self.memory: OrderedDict[str, str] = OrderedDict()
+        self.offsets: typing.Dict[str, int] = {}
+        self.hits = 0
+        self.misses = 0
+        self._file: typing.Optional[typing.BinaryIO] = None
+        if path is not None:
+            self._load()
+
+    def __len__(self) -> int:
+        return len(self.offsets) if self.path is not None else len(self.memory)
+
+    def __contains__(self, key: str) -> bool:
+        return key in self.memory or key in self.offsets
+
+    @staticmethod
+    def make_key(job: str, ignore: typing.Optional[str] = None) -> str:
+        """Hash the job together with the ignored moves, which are order independent."""
+        ignored = sorted(set(m for m in ignore.split(";") if m)) if ignore else []
+        return hashlib.sha256((job + "|" + ";".join(ignored)).encode()).hexdigest()
+
+    def get(self, key: str) -> typing.Optional[str]:
+        output = self.memory.get(key)
+        if output is not None:
+            self.memory.move_to_end(key)
+            self.hits += 1
+            return output
+
+        offset = self.offsets.get(key)
+        if offset is None:
+            self.misses += 1
+            return None
+        assert self._file is not None
+        self._file.seek(offset)
+        _, output = self._decode(self._file.readline())
+        self._remember(key, output)
+        self.hits += 1
+        return output
+
+    def put(self, key: str, output: str):
+        if key in self:
+            return
+        self._remember(key, output)
+        if self._file is not None:
+            self._file.seek(0, os.SEEK_END)
+            self.offsets[key] = self._file.tell()
+            self._file.write(self._encode(key, output))
+            self._file.flush()
+
+    def close(self):
+        if self._file is not None:
+            self._file.close()
+            self._file = None
+
+    def _remember(self, key: str, output: str):
+        self.memory[key] = output
+        self.memory.move_to_end(key)
+        while len(self.memory) > self.capacity:
+            self.memory.popitem(last=False)
+
+    def _load(self):
+        assert self.path is not None
+        self._file = open(self.path, "a+b")
+        self._file.seek(0)
+        offset = 0
+        for line in self._file:
+            try:
+                key, _ = self._decode(line)
+            except ValueError:
+                break  # a record torn by a crash, everything after it is dropped
+            self.offsets[key] = offset
+            offset += len(line)
+        self._file.truncate(offset)
+
+    @staticmethod
+    def _encode(key: str, output: str) -> bytes:
+        return (key + "\t" + json.dumps(output) + "\n").encode()
+
+    @staticmethod
+    def _decode(line: bytes) -> typing.Tuple[str, str]:
+        if not line.endswith(b"\n"):
+            raise ValueError("Incomplete cache record")
+        key, _, encoded = line.decode().partition("\t")
+        return key, json.loads(encoded)
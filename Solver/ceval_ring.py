@@ -0,0 +1,377 @@
+import asyncio
+import multiprocessing
+import os
+import time
+import typing
+from multiprocessing import shared_memory
+import numpy as np
+from sgf_tool import DynamicLibrary as dl
+from .book import OpeningBook
+from .cache import EvaluationCache
+from .coutput_parser import WHITE_FLAG
+from .engine import NCTU6Engine
+from .mock_engine import MockNCTU6Engine
+from .solver_node import SolverNodeAllocator
+from .symmetry import MOVE_PATTERN, NUM_POINTS, coords_to_index, index_to_coords
+
+base_dir = os.path.dirname(os.path.abspath(__file__))
+lib = dl.DynamicLibrary(extra_compile_flags=['-I' + base_dir])
+lib.compile_string(
+    r'''
+#include "eval_ring.hpp"
+
+API uint64_t eval_ring_bytes(uint64_t capacity, uint64_t record_size) {
+    return EvalRing::bytes_required(capacity, record_size);
+}
+
+API bool eval_ring_init(void* memory, uint64_t capacity, uint64_t record_size) {
+    return EvalRing::init(memory, capacity, record_size);
+}
+
+API bool eval_ring_valid(void* memory, uint64_t record_size) {
+    return EvalRing(memory).valid(record_size);
+}
+
+API uint64_t eval_ring_push(void* memory, const void* records, uint64_t count) {
+    return EvalRing(memory).push(records, count);
+}
+
+API uint64_t eval_ring_pop(void* memory, void* records, uint64_t count) {
+    return EvalRing(memory).pop(records, count);
+}
+
+API uint64_t eval_ring_size(void* memory) {
+    return EvalRing(memory).size();
+}
+
+API void eval_ring_close(void* memory) {
+    EvalRing(memory).close();
+}
+
+API bool eval_ring_closed(void* memory) {
+    return EvalRing(memory).closed();
+}
+
+API uint64_t eval_request_size() {
+    return sizeof(EvalRequest);
+}
+
+API uint64_t eval_response_size() {
+    return sizeof(EvalResponse);
+}
+''', functions={
+        'eval_ring_bytes': {'argtypes': [dl.uint64, dl.uint64], 'restype': dl.uint64},
+        'eval_ring_init': {'argtypes': [dl.void_p, dl.uint64, dl.uint64], 'restype': dl.bool},
+        'eval_ring_valid': {'argtypes': [dl.void_p, dl.uint64], 'restype': dl.bool},
+        'eval_ring_push': {'argtypes': [dl.void_p, dl.void_p, dl.uint64], 'restype': dl.uint64},
+        'eval_ring_pop': {'argtypes': [dl.void_p, dl.void_p, dl.uint64], 'restype': dl.uint64},
+        'eval_ring_size': {'argtypes': [dl.void_p], 'restype': dl.uint64},
+        'eval_ring_close': {'argtypes': [dl.void_p], 'restype': dl.void},
+        'eval_ring_closed': {'argtypes': [dl.void_p], 'restype': dl.bool},
+        'eval_request_size': {'argtypes': [], 'restype': dl.uint64},
+        'eval_response_size': {'argtypes': [], 'restype': dl.uint64},
+    })
+
+MAX_OUTPUT = 2032
+# the records of eval_ring.hpp
+REQUEST_DTYPE = np.dtype([("id", "<u8"), ("num_moves", "<u2"), ("num_ignore", "<u2"), ("points", "<u2", (NUM_POINTS,))], align=True)
+RESPONSE_DTYPE = np.dtype([("id", "<u8"), ("length", "<u4"), ("status", "<u4"), ("output", f"S{MAX_OUTPUT}")], align=True)
+assert REQUEST_DTYPE.itemsize == lib.eval_request_size() and RESPONSE_DTYPE.itemsize == lib.eval_response_size()  # type: ignore[attr-defined]
+
+# (id, job, ignore) as in the engine arguments, e.g. (7, ";B[JJ];W[IH]", ";W[HI]")
+Request = typing.Tuple[int, str, typing.Optional[str]]
+# (id, status, output), the output is the error message with RESPONSE_ERROR and None with RESPONSE_TRUNCATED
+Response = typing.Tuple[int, int, typing.Optional[str]]
+
+# `EvalStatus` of eval_ring.hpp, plus the status `take_responses` gives outputs cut at `MAX_OUTPUT` bytes
+RESPONSE_OK = 0
+RESPONSE_ERROR = 1
+RESPONSE_TRUNCATED = 2
+
+
+def pack_moves(text: str) -> typing.List[int]:
+    return [coords_to_index(coords) | (WHITE_FLAG if player == "W" else 0) for player, coords in MOVE_PATTERN.findall(text)]
+
+
+def unpack_moves(points: typing.Iterable[int]) -> str:
+    return "".join(f";{'W' if point & WHITE_FLAG else 'B'}[{index_to_coords(point & ~WHITE_FLAG)}]" for point in points)
+
+
+class EvalRings:
+    """
+    A request ring and a response ring of fixed-size binary records (see `EvalRing` in
+    eval_ring.hpp) in one shared-memory segment, which other processes open by `name`.
+
+    The solver pushes requests and pops responses, adapter processes pop requests and push
+    responses, and each call moves a whole batch with one native call and no system call. An empty
+    ignore list is sent as no ignore list.
+    """
+
+    def __init__(self, name: typing.Optional[str] = None, capacity: int = 1024, create: bool = True):
+        request_bytes = -(-lib.eval_ring_bytes(capacity, REQUEST_DTYPE.itemsize) // 64) * 64  # type: ignore[attr-defined]
+        if create:
+            size = request_bytes + lib.eval_ring_bytes(capacity, RESPONSE_DTYPE.itemsize)  # type: ignore[attr-defined]
+            self.memory = shared_memory.SharedMemory(name, create=True, size=size)
+        else:
+            assert name is not None
+            self.memory = shared_memory.SharedMemory(name)
+        self.capacity = capacity
+        self._view = np.frombuffer(self.memory.buf, dtype=np.uint8)
+        self._requests = self._view.ctypes.data
+        self._responses = self._requests + request_bytes
+        if create:
+            if not (lib.eval_ring_init(self._requests, capacity, REQUEST_DTYPE.itemsize) and  # type: ignore[attr-defined]
+                    lib.eval_ring_init(self._responses, capacity, RESPONSE_DTYPE.itemsize)):  # type: ignore[attr-defined]
+                self.close()
+                self.memory.unlink()
+                raise ValueError("The capacity must be a power of two.")
+        elif not (lib.eval_ring_valid(self._requests, REQUEST_DTYPE.itemsize) and  # type: ignore[attr-defined]
+                  lib.eval_ring_valid(self._responses, RESPONSE_DTYPE.itemsize)):  # type: ignore[attr-defined]
+            self.close()
+            raise ValueError(f"{name} does not hold evaluation rings of capacity {capacity}")
+        self._request_buffer = np.zeros(capacity, dtype=REQUEST_DTYPE)
+        self._response_buffer = np.zeros(capacity, dtype=RESPONSE_DTYPE)
+
+    @classmethod
+    def attach(cls, name: str, capacity: int = 1024) -> "EvalRings":
+        return cls(name, capacity, create=False)
+
+    @property
+    def name(self) -> str:
+        return self.memory.name
+
+    @property
+    def queued(self) -> int:
+        """Requests not taken by an adapter yet."""
+        return lib.eval_ring_size(self._requests)  # type: ignore[attr-defined]
+
+    def submit(self, requests: typing.Sequence[Request]) -> int:
+        """Push as many requests as fit and return their number."""
+        count = min(len(requests), self.capacity)
+        records = self._request_buffer[:count]
+        for i in range(count):
+            request_id, job, ignore = requests[i]
+            moves = pack_moves(job)
+            ignored = pack_moves(ignore) if ignore else []
+            record = records[i]
+            record["id"] = request_id
+            record["num_moves"] = len(moves)
+            record["num_ignore"] = len(ignored)
+            record["points"][:len(moves) + len(ignored)] = moves + ignored
+        return lib.eval_ring_push(self._requests, records.ctypes.data, count)  # type: ignore[attr-defined]
+
+    def take_requests(self, count: int = 1) -> typing.List[Request]:
+        records = self._request_buffer
+        taken = lib.eval_ring_pop(self._requests, records.ctypes.data, min(count, self.capacity))  # type: ignore[attr-defined]
+        requests = []
+        for record in records[:taken]:
+            num_moves, num_ignore = int(record["num_moves"]), int(record["num_ignore"])
+            points = record["points"][:num_moves + num_ignore].tolist()
+            requests.append((int(record["id"]), unpack_moves(points[:num_moves]),
+                             unpack_moves(points[num_moves:]) if num_ignore else None))
+        return requests
+
+    def put_responses(self, responses: typing.Sequence[Response]) -> int:
+        """Push as many responses as fit and return their number; outputs are cut at `MAX_OUTPUT` bytes."""
+        count = min(len(responses), self.capacity)
+        records = self._response_buffer[:count]
+        for i in range(count):
+            response_id, status, output = responses[i]
+            encoded = (output or "").encode()
+            records[i]["id"] = response_id
+            records[i]["length"] = len(encoded)
+            records[i]["status"] = status
+            records[i]["output"] = encoded[:MAX_OUTPUT]
+        return lib.eval_ring_push(self._responses, records.ctypes.data, count)  # type: ignore[attr-defined]
+
+    def take_responses(self, count: typing.Optional[int] = None) -> typing.List[Response]:
+        """Pop up to `count` responses; a cut output comes back as None with `RESPONSE_TRUNCATED`."""
+        records = self._response_buffer
+        taken = lib.eval_ring_pop(self._responses, records.ctypes.data, min(count or self.capacity, self.capacity))  # type: ignore[attr-defined]
+        responses: typing.List[Response] = []
+        for record in records[:taken]:
+            length = int(record["length"])
+            if length > MAX_OUTPUT:
+                responses.append((int(record["id"]), RESPONSE_TRUNCATED, None))
+            else:
+                responses.append((int(record["id"]), int(record["status"]), record["output"][:length].decode(errors="replace")))
+        return responses
+
+    def stop_adapters(self):
+        lib.eval_ring_close(self._requests)  # type: ignore[attr-defined]
+
+    @property
+    def stopped(self) -> bool:
+        return lib.eval_ring_closed(self._requests)  # type: ignore[attr-defined]
+
+    def close(self):
+        # the numpy view holds an export of the buffer, which must go before the segment is closed
+        self._view = None
+        self.memory.close()
+
+    def unlink(self):
+        self.memory.unlink()
+
+
+def _backoff(idle: int) -> float:
+    """Seconds to sleep after `idle` empty polls: spin first, then sleep up to a millisecond."""
+    return 0.0 if idle < 64 else min(1e-3, 1e-6 * (1 << min(idle - 64, 10)))
+
+
+def run_adapter(name: str, capacity: int = 1024, executable_path: typing.Optional[str] = None,
+                mock_decisive_rate: typing.Optional[float] = None):
+    """
+    Serve the request ring of the rings `name` until they are stopped: take one job at a time, so
+    that the other adapters share the load, run NCTU6 on it and push its output. With
+    `mock_decisive_rate` the output comes from `MockNCTU6Engine.synthesize` instead. A job whose
+    engine run fails is answered with the error, which `RingEngine` raises.
+    """
+    from .utils import execute_nctu6
+
+    rings = EvalRings.attach(name, capacity)
+    try:
+        idle = 0
+        while not rings.stopped:
+            requests = rings.take_requests(1)
+            if not requests:
+                idle += 1
+                time.sleep(_backoff(idle))
+                continue
+            idle = 0
+            for request_id, job, ignore in requests:
+                try:
+                    if mock_decisive_rate is not None:
+                        output = MockNCTU6Engine.synthesize(job, ignore, mock_decisive_rate)
+                    else:
+                        args = ["-playtsumego", job] + (["-ignore", ignore] if ignore else [])
+                        output = execute_nctu6(args, executable=executable_path) if executable_path else execute_nctu6(args)
+                    response: Response = (request_id, RESPONSE_OK, output)
+                except Exception as error:
+                    response = (request_id, RESPONSE_ERROR, f"{type(error).__name__}: {error}")
+                while not rings.put_responses([response]):
+                    time.sleep(1e-4)
+    finally:
+        rings.close()
+
+
+class RingEngine(NCTU6Engine):
+    """
+    NCTU6 engine whose jobs go through `EvalRings` to `adapters` adapter processes, each running
+    NCTU6 for one job at a time. Jobs submitted together, e.g. by concurrent `evaluate_async`
+    calls, wait in the request ring for the next free adapter; pushing them costs no system call.
+    Call `close` to stop the adapters and free the shared memory.
+
+    A job whose engine run failed raises `RuntimeError`, as does an adapter process exiting while
+    jobs are pending. An output too long for a response record is run again in this process.
+    """
+
+    def __init__(self, executable_path: typing.Optional[str] = None, cache: typing.Optional[EvaluationCache] = None,
+                 canonicalize: bool = False, book: typing.Optional[OpeningBook] = None,
+                 node_allocator: typing.Optional[SolverNodeAllocator] = None, adapters: typing.Optional[int] = None,
+                 capacity: int = 1024, mock_decisive_rate: typing.Optional[float] = None):
+        super().__init__(executable_path=executable_path, cache=cache, canonicalize=canonicalize, book=book,
+                         node_allocator=node_allocator)
+        self.rings = EvalRings(capacity=capacity)
+        self.mock_decisive_rate = mock_decisive_rate
+        self._next_id = 0
+        self._responses: typing.Dict[int, typing.Tuple[int, typing.Optional[str]]] = {}
+        context = multiprocessing.get_context("spawn")
+        self._processes = [
+            context.Process(target=run_adapter, args=(self.rings.name, capacity, executable_path, mock_decisive_rate), daemon=True)
+            for _ in range(adapters or os.cpu_count() or 1)
+        ]
+        for process in self._processes:
+            process.start()
+
+    def close(self):
+        self.rings.stop_adapters()
+        for process in self._processes:
+            process.join()
+        self._processes = []
+        self.rings.close()
+        self.rings.unlink()
+
+    def __enter__(self) -> "RingEngine":
+        return self
+
+    def __exit__(self, exc_type, exc_val, exc_tb):
+        self.close()
+
+    def _execute(self, args: typing.List[str]) -> str:
+        return self._execute_many([args])[0]
+
+    async def _execute_async(self, args: typing.List[str]) -> str:
+        (request_id,) = self._submit([args])
+        idle = 0
+        while request_id not in self._responses:
+            if self._collect():
+                idle = 0
+            else:
+                idle += 1
+                self._check_adapters(idle)
+            await asyncio.sleep(_backoff(idle))
+        output = self._output(self._responses.pop(request_id))
+        if output is None:
+            if self.mock_decisive_rate is None:
+                return await super()._execute_async(args)
+            return self._rerun(args)
+        return output
+
+    def _execute_many(self, args_list: typing.Sequence[typing.List[str]]) -> typing.List[str]:
+        """Run several jobs, submitting as many at once as the request ring holds."""
+        ids = []
+        submitted = 0
+        idle = 0
+        while submitted < len(args_list) or any(i not in self._responses for i in ids):
+            if submitted < len(args_list):
+                new_ids = self._submit(args_list[submitted:])
+                ids.extend(new_ids)
+                submitted += len(new_ids)
+            if self._collect():
+                idle = 0
+            else:
+                idle += 1
+                self._check_adapters(idle)
+                time.sleep(_backoff(idle))
+        # every response is taken before an error is raised, so none is left behind
+        responses = [self._responses.pop(i) for i in ids]
+        outputs = [self._output(response) for response in responses]
+        return [output if output is not None else self._rerun(args) for args, output in zip(args_list, outputs)]
+
+    @staticmethod
+    def _output(response: typing.Tuple[int, typing.Optional[str]]) -> typing.Optional[str]:
+        """The output of a collected response, None if it was cut; a failed job raises its error."""
+        status, output = response
+        if status == RESPONSE_ERROR:
+            raise RuntimeError(f"NCTU6 adapter failed: {output}")
+        return output
+
+    def _rerun(self, args: typing.List[str]) -> str:
+        """Run a job whose output did not fit in a response record here instead."""
+        if self.mock_decisive_rate is not None:
+            return MockNCTU6Engine.synthesize(args[1], args[3] if len(args) > 3 else None, self.mock_decisive_rate)
+        return super()._execute(args)
+
+    def _check_adapters(self, idle: int):
+        """Raise if an adapter has exited, whose job would never be answered; checked once polls sleep."""
+        if idle < 64:
+            return
+        for process in self._processes:
+            if not process.is_alive():
+                raise RuntimeError(f"NCTU6 adapter process {process.pid} exited with code {process.exitcode}")
+
+    def _submit(self, args_list: typing.Sequence[typing.List[str]]) -> typing.List[int]:
+        """Push the jobs that fit into the request ring and return their ids."""
+        requests: typing.List[typing.Tuple[int, str, typing.Optional[str]]] = []
+        for args in args_list[:max(0, self.rings.capacity - self.rings.queued)]:
+            ignore = args[3] if len(args) > 3 else None
+            requests.append((self._next_id + len(requests), args[1], ignore))
+        pushed = self.rings.submit(requests)
+        self._next_id += pushed
+        return [request_id for request_id, _, _ in requests[:pushed]]
+
+    def _collect(self) -> int:
+        responses = self.rings.take_responses()
+        for request_id, status, output in responses:
+            self._responses[request_id] = (status, output)
+        return len(responses)
@@ -0,0 +1,334 @@
+import array
+import dataclasses
+import gc
+import json
+import os
+import struct
+import sys
+import threading
+import time
+import traceback
+import typing
+from .cache import EvaluationCache
+from .dfpn import DFPN
+from .solver_node import SolverNode
+from .types import BoardState, SearchMode
+
+if typing.TYPE_CHECKING:
+    from .solver import Solver
+
+MAGIC = b"C6CKPT02"
+SECTION = struct.Struct("<Q")  # byte length of the section that follows
+# separators of the property blob: nodes, properties, and the tag and values of a property
+NODE_SEPARATOR = "\x1d"
+PROPERTY_SEPARATOR = "\x1e"
+VALUE_SEPARATOR = "\x1f"
+# per-node columns in pre-order, as (attribute, array type code)
+NODE_COLUMNS = [
+    ("num_children", "I"),
+    ("visit_count", "q"),
+    ("winrate", "d"),
+    ("status", "b"),
+    ("proof_number", "q"),
+    ("disproof_number", "q"),
+    ("expansions", "q"),
+    ("exhausted", "B"),
+    ("cut_off", "B"),
+]
+
+
+def encode(solver: "Solver") -> typing.List[bytes]:
+    """
+    Return the search state of `solver` as the sections of a checkpoint file: a JSON header, one
+    column per node attribute in pre-order, the node properties, the df-pn transposition table and
+    the memory tier of the engine cache.
+    """
+    tree = solver.tree
+    columns = {name: array.array(code) for name, code in NODE_COLUMNS}
+    properties: typing.List[str] = []
+    job_index = -1
+    stack = [tree.root] if tree.root is not None else []
+    while stack:
+        node = stack.pop()
+        if node is tree.job_node:
+            job_index = len(properties)
+        columns["num_children"].append(node.num_children)
+        columns["visit_count"].append(node.visit_count)
+        columns["winrate"].append(node.winrate)
+        columns["status"].append(node.status.value)
+        columns["proof_number"].append(node.proof_number)
+        columns["disproof_number"].append(node.disproof_number)
+        columns["expansions"].append(node.expansions)
+        columns["exhausted"].append(node.exhausted)
+        columns["cut_off"].append(node.cut_off)
+        properties.append(PROPERTY_SEPARATOR.join(
+            VALUE_SEPARATOR.join([tag] + values) for tag, values in node.properties.items()))
+        children = list(node.get_children_iter())
+        stack.extend(reversed(children))
+
+    header = {
+        "mode": solver.mode.value,
+        "num_nodes": len(properties),
+        "job_node": job_index,
+        "prunes": tree.prunes,
+        "pruned_nodes": tree.pruned_nodes,
+        "stats": dataclasses.asdict(solver.stats),
+        "time": time.time(),
+    }
+    sections = [json.dumps(header).encode()]
+    sections.extend(_pack(columns[name]) for name, _ in NODE_COLUMNS)
+    sections.append(NODE_SEPARATOR.join(properties).encode())
+
+    tt_keys: typing.List[str] = []
+    tt_numbers = array.array("q")
+    if isinstance(tree, DFPN):
+        for key, (pn, dn) in tree.tt.items():
+            tt_keys.append(key)
+            tt_numbers.extend((pn, dn))
+    sections.append("\n".join(tt_keys).encode())
+    sections.append(_pack(tt_numbers))
+
+    # a cache with a file is persistent already
+    cache = getattr(solver.engine, "cache", None)
+    entries = list(cache.memory.items()) if isinstance(cache, EvaluationCache) and cache.path is None else []
+    sections.append(json.dumps(entries).encode())
+    return sections
+
+
+def write(solver: "Solver", path: str):
+    """Write a checkpoint of `solver` to `path` synchronously."""
+    write_sections(encode(solver), path)
+
+
+def write_sections(sections: typing.List[bytes], path: str):
+    """Write encoded sections through a temporary file, so that `path` always holds a whole checkpoint."""
+    temporary = path + ".tmp"
+    with open(temporary, "wb") as f:
+        f.write(MAGIC)
+        for section in sections:
+            f.write(SECTION.pack(len(section)))
+            f.write(section)
+        f.flush()
+        os.fsync(f.fileno())
+    os.replace(temporary, path)
+
+
+def load(solver: "Solver", path: str):
+    """
+    Replace the search state of `solver` with the checkpoint at `path`. The solver must use the
+    search mode the checkpoint was written with; its engine and cache are kept.
+    """
+    with open(path, "rb") as f:
+        data = f.read()
+    if not data.startswith(MAGIC):
+        raise ValueError(f"{path} is not a checkpoint")
+    sections: typing.List[bytes] = []
+    offset = len(MAGIC)
+    while offset < len(data):
+        if offset + SECTION.size > len(data):
+            raise ValueError(f"{path} is truncated")
+        (size,) = SECTION.unpack_from(data, offset)
+        offset += SECTION.size
+        if offset + size > len(data):
+            raise ValueError(f"{path} is truncated")
+        sections.append(data[offset:offset + size])
+        offset += size
+    if len(sections) != len(NODE_COLUMNS) + 5:
+        raise ValueError(f"{path} is not a checkpoint")
+
+    header = json.loads(sections[0])
+    if header["mode"] != solver.mode.value:
+        raise ValueError(f"{path} was written in {SearchMode(header['mode']).name} mode, the solver uses {solver.mode.name}")
+    num_nodes = header["num_nodes"]
+    columns = [_unpack(code, section) for (_, code), section in zip(NODE_COLUMNS, sections[1:])]
+    properties = sections[len(NODE_COLUMNS) + 1].decode().split(NODE_SEPARATOR) if num_nodes else []
+    if any(len(column) != num_nodes for column in columns) or len(properties) != num_nodes:
+        raise ValueError(f"{path} is corrupt")
+
+    tree = solver.tree
+    if tree.root is not None:
+        tree.node_allocator.release(tree.root)
+    tree.root = _build_tree(tree.node_allocator.allocate, columns, properties)
+    tree.job_node = tree.root
+    tree.num_nodes = num_nodes
+    tree.prunes = header["prunes"]
+    tree.pruned_nodes = header["pruned_nodes"]
+    if header["job_node"] >= 0:
+        tree.job_node = _node_at(tree.root, header["job_node"])
+    solver.stats = type(solver.stats)(**header["stats"])
+
+    if isinstance(tree, DFPN):
+        keys = sections[len(NODE_COLUMNS) + 2].decode().split("\n")
+        numbers = _unpack("q", sections[len(NODE_COLUMNS) + 3])
+        tree.tt.clear()
+        if numbers:
+            for i, key in enumerate(keys):
+                tree.tt.store(key, numbers[2 * i], numbers[2 * i + 1])
+
+    cache = getattr(solver.engine, "cache", None)
+    if isinstance(cache, EvaluationCache):
+        for key, output in json.loads(sections[len(NODE_COLUMNS) + 4]):
+            cache.put(key, output)
+
+
+class Checkpointer:
+    """
+    Periodic checkpoints of a solver, taken every `interval` seconds of search by `poll`.
+
+    Where `os.fork` exists, a checkpoint forks the process and the child writes the copy-on-write
+    snapshot of the tree while the parent goes on searching, so the search only pauses for the
+    fork itself; pages are copied as the search touches them, so memory may grow up to twice the
+    tree size while a checkpoint is written. Elsewhere the state is encoded in place and written
+    out by a thread. A background thread waits for each checkpoint, and one runs at a time.
+    """
+
+    def __init__(self, solver: "Solver", path: str, interval: float = 600.0, fork: typing.Optional[bool] = None):
+        self.solver = solver
+        self.path = path
+        self.interval = interval
+        self.fork = hasattr(os, "fork") if fork is None else fork
+        self.checkpoints = 0
+        self.failures = 0
+        self.last_pause_seconds = 0.0
+        self.max_pause_seconds = 0.0
+        self.last_write_seconds = 0.0
+        self._last_time = time.perf_counter()
+        self._thread: typing.Optional[threading.Thread] = None
+
+    def poll(self) -> bool:
+        """Start a checkpoint if `interval` has passed since the last one; returns whether one started."""
+        if time.perf_counter() - self._last_time < self.interval:
+            return False
+        return self.checkpoint()
+
+    def checkpoint(self) -> bool:
+        """Start a checkpoint unless one is being written; returns whether one started."""
+        if self.running:
+            return False
+        start = time.perf_counter()
+        if self.fork:
+            pid = self._fork()
+            target: typing.Callable[[], bool] = lambda: os.waitpid(pid, 0)[1] == 0
+        else:
+            sections = encode(self.solver)
+            target = lambda: self._write(sections)
+        self._last_time = time.perf_counter()
+        self.last_pause_seconds = self._last_time - start
+        self.max_pause_seconds = max(self.max_pause_seconds, self.last_pause_seconds)
+        self._thread = threading.Thread(target=self._wait, args=(target, start), daemon=True)
+        self._thread.start()
+        return True
+
+    @property
+    def running(self) -> bool:
+        return self._thread is not None and self._thread.is_alive()
+
+    def wait(self):
+        """Wait for the checkpoint being written, if any."""
+        if self._thread is not None:
+            self._thread.join()
+            self._thread = None
+
+    def _fork(self) -> int:
+        # frozen objects are left alone by the collector, which would otherwise copy their pages
+        gc.freeze()
+        try:
+            pid = os.fork()
+        except OSError:
+            gc.unfreeze()
+            raise
+        if pid == 0:
+            status = 1
+            try:
+                gc.disable()
+                write(self.solver, self.path)
+                status = 0
+            except BaseException:
+                traceback.print_exc()
+            finally:
+                sys.stderr.flush()
+                os._exit(status)
+        gc.unfreeze()
+        return pid
+
+    def _write(self, sections: typing.List[bytes]) -> bool:
+        try:
+            write_sections(sections, self.path)
+        except OSError:
+            traceback.print_exc()
+            return False
+        return True
+
+    def _wait(self, target: typing.Callable[[], bool], start: float):
+        if target():
+            self.checkpoints += 1
+        else:
+            self.failures += 1
+        self.last_write_seconds = time.perf_counter() - start
+
+
+def _pack(values: array.array) -> bytes:
+    if sys.byteorder != "little":
+        values = array.array(values.typecode, values)
+        values.byteswap()
+    return values.tobytes()
+
+
+def _unpack(code: str, data: bytes) -> array.array:
+    values = array.array(code)
+    values.frombytes(data)
+    if sys.byteorder != "little":
+        values.byteswap()
+    return values
+
+
+def _build_tree(allocate: typing.Callable[[], SolverNode], columns: typing.List[array.array],
+                properties: typing.List[str]) -> typing.Optional[SolverNode]:
+    """Rebuild the nodes from their pre-order columns, linking them directly instead of through `add_child`."""
+    num_children, visit_counts, winrates, statuses, proof_numbers, disproof_numbers, expansions, exhausted, cut_off = columns
+    states = {state.value: state for state in BoardState}
+    root: typing.Optional[SolverNode] = None
+    # (node, children still to read, last child read)
+    stack: typing.List[typing.List] = []
+    for i in range(len(properties)):
+        node = allocate()
+        node.visit_count = visit_counts[i]
+        node.winrate = winrates[i]
+        node.status = states[statuses[i]]
+        node.proof_number = proof_numbers[i]
+        node.disproof_number = disproof_numbers[i]
+        node.expansions = expansions[i]
+        node.exhausted = bool(exhausted[i])
+        node.cut_off = bool(cut_off[i])
+        if properties[i]:
+            for item in properties[i].split(PROPERTY_SEPARATOR):
+                tag, *values = item.split(VALUE_SEPARATOR)
+                node.properties[tag] = values
+
+        if stack:
+            frame = stack[-1]
+            parent = frame[0]
+            node.parent = parent
+            if frame[2] is None:
+                parent.child = node
+            else:
+                frame[2].next_sibling = node
+            parent.num_children += 1
+            frame[1] -= 1
+            frame[2] = node
+            if frame[1] == 0:
+                stack.pop()
+        else:
+            root = node
+        if num_children[i]:
+            stack.append([node, num_children[i], None])
+    return root
+
+
+def _node_at(root: SolverNode, index: int) -> SolverNode:
+    """The node at `index` in pre-order."""
+    stack = [root]
+    for _ in range(index):
+        node = stack.pop()
+        stack.extend(reversed(list(node.get_children_iter())))
+    return stack[-1]
@@ -0,0 +1,119 @@
+import ctypes
+import os
+import threading
+import typing
+from dataclasses import dataclass
+import numpy as np
+from sgf_tool import DynamicLibrary as dl
+from .solver_node import SolverNode, SolverNodeAllocator
+from .symmetry import index_to_coords
+
+WHITE_FLAG = 0x8000
+MAX_MOVES = 8
+
+base_dir = os.path.dirname(os.path.abspath(__file__))
+lib = dl.DynamicLibrary(extra_compile_flags=['-I' + base_dir])
+lib.compile_string(
+    r'''
+#include "output_parser.hpp"
+
+API void parse_output(const char* buffer, size_t length, NCTU6Output* output) {
+    NCTU6OutputParser::parse_line(buffer, buffer + length, *output);
+}
+
+/**
+ * Parse `count` NCTU6 outputs stored back to back in `buffer`; output `i` is `buffer[offsets[i]:offsets[i + 1]]`.
+ * Every per-output array has `count` entries, except `moves` which holds `NCTU6_MAX_MOVES` entries per output.
+ */
+API void parse_outputs(const char* buffer, const size_t offsets[], size_t count, size_t result_lengths[], int32_t num_moves[], uint16_t moves[], int32_t labels[], double scores[]) {
+    NCTU6Output output;
+    for (size_t i = 0; i < count; ++i) {
+        NCTU6OutputParser::parse_line(buffer + offsets[i], buffer + offsets[i + 1], output);
+        result_lengths[i] = output.result_length;
+        num_moves[i] = output.num_moves;
+        for (int j = 0; j < output.num_moves; ++j) {
+            moves[i * NCTU6_MAX_MOVES + j] = output.moves[j];
+        }
+        labels[i] = output.label;
+        scores[i] = output.score;
+    }
+}
+''', functions={
+        'parse_output': {'argtypes': [dl.char_p, dl.uint64, dl.void_p], 'restype': dl.void},
+        'parse_outputs': {'argtypes': [dl.char_p, dl.npuint64arr, dl.uint64, dl.npuint64arr, dl.npint32arr, dl.npuint16arr, dl.npint32arr, dl.npdoublearr], 'restype': dl.void},
+    })
+
+
+class _NCTU6OutputStruct(ctypes.Structure):
+    _fields_ = [
+        ("result_length", ctypes.c_size_t),
+        ("num_moves", ctypes.c_int),
+        ("moves", ctypes.c_uint16 * MAX_MOVES),
+        ("label", ctypes.c_int),
+        ("score", ctypes.c_double),
+    ]
+
+
+_local = threading.local()
+
+
+@dataclass
+class NCTU6Output:
+    result: str
+    moves: typing.List[int]
+    label: int
+    score: float
+
+
+def parse_outputs(outputs: typing.Sequence[str]) -> typing.List[NCTU6Output]:
+    """Parse a batch of NCTU6 outputs with a single native call."""
+    encoded = [output.encode() for output in outputs]
+    count = len(encoded)
+    offsets = np.zeros(count + 1, dtype=np.uint64)
+    offsets[1:] = np.cumsum([len(e) for e in encoded], dtype=np.uint64)
+    result_lengths = np.zeros(count, dtype=np.uint64)
+    num_moves = np.zeros(count, dtype=np.int32)
+    moves = np.zeros(count * MAX_MOVES, dtype=np.uint16)
+    labels = np.zeros(count, dtype=np.int32)
+    scores = np.zeros(count, dtype=np.float64)
+    lib.parse_outputs(b"".join(encoded), offsets, count, result_lengths, num_moves, moves, labels, scores)  # type: ignore[attr-defined]
+
+    return [
+        NCTU6Output(
+            result=encoded[i][:result_lengths[i]].decode(),
+            moves=moves[i * MAX_MOVES:i * MAX_MOVES + num_moves[i]].tolist(),
+            label=int(labels[i]),
+            score=float(scores[i]),
+        )
+        for i in range(count)
+    ]
+
+
+def parse_output(output: str) -> NCTU6Output:
+    """Parse a single NCTU6 output into a per-thread native struct, without any intermediate arrays."""
+    parsed = getattr(_local, "output", None)
+    if parsed is None:
+        parsed = _local.output = _NCTU6OutputStruct()
+    encoded = output.encode()
+    lib.parse_output(encoded, len(encoded), ctypes.addressof(parsed))  # type: ignore[attr-defined]
+    return NCTU6Output(
+        result=encoded[:parsed.result_length].decode(),
+        moves=parsed.moves[:parsed.num_moves],
+        label=parsed.label,
+        score=parsed.score,
+    )
+
+
+def moves_to_nodes(moves: typing.Sequence[int], node_allocator: typing.Optional[SolverNodeAllocator] = None) -> typing.Optional[SolverNode]:
+    """Build a chain of nodes, one per packed move, and return its first node."""
+    root: typing.Optional[SolverNode] = None
+    current: typing.Optional[SolverNode] = None
+    for move in moves:
+        node = node_allocator.allocate() if node_allocator is not None else SolverNode()
+        node["W" if move & WHITE_FLAG else "B"] = [index_to_coords(move & ~WHITE_FLAG)]
+        if current is None:
+            root = node
+        else:
+            current.add_child(node)
+        current = node
+    return root
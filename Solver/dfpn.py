@@ -0,0 +1,293 @@
+import time
+import typing
+from collections import OrderedDict
+from .engine import Engine
+from .solver_node import SolverNode, SolverNodeAllocator
+from .tree import Tree
+from .types import BoardState
+from .utils import get_stone_player, node_to_position_key
+
+PN_INFINITY = 1 << 30
+
+
+class TranspositionTable:
+    """
+    Bounded map from position keys to (proof number, disproof number).
+
+    When the table is full the least recently used unsolved entry is evicted first, so that
+    proven and disproven positions survive as long as possible. Solved and unsolved entries are
+    kept in LRU lists of their own, which makes every eviction O(1).
+    """
+
+    def __init__(self, capacity: int = 1 << 20):
+        self.capacity = capacity
+        self.solved: OrderedDict[str, typing.Tuple[int, int]] = OrderedDict()
+        self.unsolved: OrderedDict[str, typing.Tuple[int, int]] = OrderedDict()
+        self.hits = 0
+        self.misses = 0
+
+    def __len__(self) -> int:
+        return len(self.solved) + len(self.unsolved)
+
+    def items(self) -> typing.Iterator[typing.Tuple[str, typing.Tuple[int, int]]]:
+        """The entries, unsolved then solved, each from the least to the most recently used."""
+        yield from self.unsolved.items()
+        yield from self.solved.items()
+
+    def clear(self):
+        self.solved.clear()
+        self.unsolved.clear()
+
+    def lookup(self, key: str) -> typing.Optional[typing.Tuple[int, int]]:
+        entries = self.unsolved
+        entry = entries.get(key)
+        if entry is None:
+            entries = self.solved
+            entry = entries.get(key)
+        if entry is None:
+            self.misses += 1
+            return None
+        self.hits += 1
+        entries.move_to_end(key)
+        return entry
+
+    def store(self, key: str, proof_number: int, disproof_number: int):
+        if proof_number != 0 and disproof_number != 0:
+            entries, others = self.unsolved, self.solved
+        else:
+            entries, others = self.solved, self.unsolved
+        others.pop(key, None)
+        entries[key] = (proof_number, disproof_number)
+        entries.move_to_end(key)
+        while len(self) > self.capacity:
+            self._evict()
+
+    def _evict(self):
+        (self.unsolved or self.solved).popitem(last=False)
+
+
+class DFPN(Tree):
+    """
+    Depth-first proof-number search proving that black wins the loaded position.
+
+    Every node holds one stone, so the node type follows the stone count: positions where black
+    places the next stone are OR nodes, the others are AND nodes. Candidate moves are produced
+    lazily by the engine. A node evaluated by the engine, or holding the first stone of a pair the
+    engine returned, keeps a virtual child with (1, 1) that stands for all moves not generated yet.
+    Selecting it asks the engine again, with the generated moves passed through `-ignore`. When the
+    engine returns no further move the remaining moves are treated as losing for the side to move,
+    as NCTU6 already prunes its candidates that way.
+
+    Generation is cut off once `max_branching` candidates exist, or when the engine answers with a
+    move already generated. The moves left out are unknown: they stay as a virtual child that is
+    never selected and counts as (PN_INFINITY, 1), so the node cannot be proven through them for
+    the side to move, nor ever solved by them for the opponent.
+    """
+
+    def __init__(self, engine: Engine, max_branching: int = 8, tt_capacity: int = 1 << 20,
+                 node_allocator: typing.Optional[SolverNodeAllocator] = None, max_nodes: typing.Optional[int] = None):
+        super().__init__(node_allocator, max_nodes)
+        self.engine = engine
+        self.max_branching = max_branching
+        self.tt = TranspositionTable(tt_capacity)
+        self.evaluations = 0
+        self.evaluate_seconds = 0.0
+        self.max_evaluations: typing.Optional[int] = None
+        # called before every engine evaluation, while the tree is consistent, e.g. to take checkpoints
+        self.before_evaluation: typing.Optional[typing.Callable[[], typing.Any]] = None
+
+    def get_job_node(self) -> SolverNode:
+        """Return the position to solve, i.e. the end of the main line of the loaded SGF."""
+        if not self.root or self.job_node is None:
+            raise ValueError("No job set. Call load_sgf() first.")
+        return self.job_node
+
+    def solve(self, max_evaluations: typing.Optional[int] = None) -> BoardState:
+        node = self.get_job_node()
+        stones = 0
+        ptr = node
+        while ptr:
+            stones += 1
+            ptr = ptr.parent
+
+        self.evaluations = 0
+        self.max_evaluations = max_evaluations
+        self._mid(node, stones, PN_INFINITY, PN_INFINITY)
+        return node.status
+
+    def _budget_exhausted(self) -> bool:
+        return self.max_evaluations is not None and self.evaluations >= self.max_evaluations
+
+    @staticmethod
+    def _is_or_node(stones: int) -> bool:
+        return get_stone_player(stones) == "B"
+
+    def _mid(self, node: SolverNode, stones: int, pn_threshold: int, dn_threshold: int):
+        if node.status != BoardState.UNKNOWN:
+            return
+
+        if node.child is None and node.expansions == 0:
+            self._generate(node, stones)
+
+        is_or = self._is_or_node(stones)
+        self._update(node, is_or)
+        while node.proof_number < pn_threshold and node.disproof_number < dn_threshold and not self._budget_exhausted():
+            best, second_best = self._select(node, is_or)
+            if best is None:
+                self._generate(node, stones)
+            else:
+                if is_or:
+                    child_pn_threshold = min(pn_threshold, second_best + 1)
+                    child_dn_threshold = dn_threshold - node.disproof_number + best.disproof_number
+                else:
+                    child_pn_threshold = pn_threshold - node.proof_number + best.proof_number
+                    child_dn_threshold = min(dn_threshold, second_best + 1)
+                self._mid(best, stones + 1, child_pn_threshold, child_dn_threshold)
+            self._update(node, is_or)
+
+        self.tt.store(node_to_position_key(node), node.proof_number, node.disproof_number)
+
+    def _pruned_child(self, parent: SolverNode):
+        # the pruned move is generated again through the virtual child, its numbers are in the table
+        parent.exhausted = False
+        parent.cut_off = False
+
+    @staticmethod
+    def _has_virtual_child(node: SolverNode) -> bool:
+        # the first stone of a pair has children before it was ever evaluated
+        return (node.expansions > 0 or node.child is not None) and not node.exhausted
+
+    def _select(self, node: SolverNode, is_or: bool) -> typing.Tuple[typing.Optional[SolverNode], int]:
+        """
+        Return the child with the smallest proof number (OR) or disproof number (AND) and the
+        second smallest value. `None` stands for the virtual child.
+        """
+        best: typing.Optional[SolverNode] = None
+        best_value = PN_INFINITY + 1
+        second_best = PN_INFINITY
+        candidates: typing.List[typing.Tuple[int, typing.Optional[SolverNode]]] = []
+        child = node.child
+        while child:
+            candidates.append((child.proof_number if is_or else child.disproof_number, child))
+            child = child.next_sibling
+        # generated moves are preferred over asking the engine for another one
+        if self._has_virtual_child(node):
+            candidates.append((1, None))
+        for value, candidate in candidates:
+            if value < best_value:
+                second_best = best_value
+                best, best_value = candidate, value
+            elif value < second_best:
+                second_best = value
+        return best, min(second_best, PN_INFINITY)
+
+    def _update(self, node: SolverNode, is_or: bool):
+        if node.status != BoardState.UNKNOWN or (node.child is None and node.expansions == 0):
+            return
+
+        min_value = PN_INFINITY
+        sum_value = 0
+        if self._has_virtual_child(node):
+            min_value, sum_value = 1, 1
+        elif node.cut_off:
+            # the moves left out by a cut-off count as (PN_INFINITY, 1): black cannot prove anything
+            # through them, and they keep black's node from being disproven
+            min_value, sum_value = (PN_INFINITY, 1) if is_or else (1, PN_INFINITY)
+        child = node.child
+        while child:
+            # the value the node minimises and the value it sums, from the view of the side to move
+            minimised = child.proof_number if is_or else child.disproof_number
+            summed = child.disproof_number if is_or else child.proof_number
+            min_value = min(min_value, minimised)
+            sum_value = min(sum_value + summed, PN_INFINITY)
+            child = child.next_sibling
+
+        if is_or:
+            node.proof_number, node.disproof_number = min_value, sum_value
+        else:
+            node.proof_number, node.disproof_number = sum_value, min_value
+        self._set_status(node)
+
+    @staticmethod
+    def _set_status(node: SolverNode):
+        if node.proof_number == 0:
+            node.status = BoardState.BLACK_WIN
+            node.disproof_number = PN_INFINITY
+        elif node.disproof_number == 0:
+            node.status = BoardState.WHITE_WIN
+            node.proof_number = PN_INFINITY
+
+    def _generate(self, node: SolverNode, stones: int):
+        """Ask the engine for the next candidate of `node`, or for its value if it is a leaf."""
+        if self._budget_exhausted():
+            return
+        if self.before_evaluation is not None:
+            self.before_evaluation()
+
+        ignore_str = node.get_child_moves_string()
+        start = time.perf_counter()
+        if ignore_str:
+            result = self.engine.evaluate(node, ignore=ignore_str)
+        else:
+            result = self.engine.evaluate(node)
+        self.evaluate_seconds += time.perf_counter() - start
+        self.evaluations += 1
+        node.expansions += 1
+
+        # without -ignore the engine judges the whole position, otherwise only the moves left out
+        side_wins = BoardState.BLACK_WIN if self._is_or_node(stones) else BoardState.WHITE_WIN
+        if result.state != BoardState.UNKNOWN and (not ignore_str or result.state == side_wins):
+            node.proof_number, node.disproof_number = (0, PN_INFINITY) if result.state == BoardState.BLACK_WIN else (PN_INFINITY, 0)
+            self._set_status(node)
+            return
+
+        if result.state != BoardState.UNKNOWN or not result.moves:
+            node.exhausted = True
+            return
+
+        # an answer already in the tree, e.g. when the engine disregards -ignore, says nothing about
+        # the other moves, so neither it nor the branching limit counts as exhaustion
+        if not self._attach(node, result.moves) or node.num_children >= self.max_branching:
+            node.exhausted = True
+            node.cut_off = True
+
+    def _attach(self, node: SolverNode, moves: SolverNode) -> bool:
+        """
+        Add the move sequence `moves` under `node`, sharing the prefix with existing children.
+        Returns False if the whole sequence already exists.
+        """
+        chain = moves
+        while chain:
+            existing = self._find_child(node, chain.get_move_string())
+            if existing is None:
+                node.add_child(chain.detach())
+                self.num_nodes += self.count_nodes(chain)
+                self._initialize(chain)
+                self.enforce_budget(node)
+                return True
+            node = existing
+            chain = chain.child
+        return False
+
+    def _initialize(self, node: SolverNode):
+        child = node.child
+        while child:
+            self._initialize(child)
+            child = child.next_sibling
+
+        if node.child:
+            self._update(node, self._is_or_node(self._count_stones(node)))
+            return
+        entry = self.tt.lookup(node_to_position_key(node))
+        if entry is not None:
+            node.proof_number, node.disproof_number = entry
+            self._set_status(node)
+
+    @staticmethod
+    def _count_stones(node: SolverNode) -> int:
+        stones = 0
+        while node:
+            stones += 1
+            node = node.parent
+        return stones
+
@@ -0,0 +1,336 @@
+import collections
+import ipaddress
+import multiprocessing
+import os
+import queue
+import secrets
+import socket
+import threading
+import time
+import typing
+from dataclasses import dataclass
+from multiprocessing.connection import Client, Connection, Listener, wait
+from .cache import EvaluationCache
+from .dfpn import DFPN, PN_INFINITY
+from .engine import NCTU6Engine
+from .mock_engine import MockNCTU6Engine
+from .solver import Solver
+from .solver_node import SolverNode
+from .types import BoardState, SearchMode
+from .utils import node_to_job, node_to_position_key
+
+Address = typing.Union[str, typing.Tuple[str, int]]
+
+
+@dataclass
+class WorkerConfig:
+    """How workers build their solvers, sent to every worker when it connects."""
+    mode: SearchMode = SearchMode.DFPN
+    executable_path: typing.Optional[str] = None
+    canonicalize: bool = False
+    # answer with `MockNCTU6Engine` at this decisive rate instead of running NCTU6, e.g. for tests
+    mock_decisive_rate: typing.Optional[float] = None
+
+
+@dataclass
+class WorkerStats:
+    jobs: int = 0
+    proven: int = 0
+    evaluations: int = 0
+    nodes: int = 0
+    seconds: float = 0.0
+
+
+def parse_address(text: str) -> Address:
+    """`HOST:PORT` for TCP, anything else is the path of a Unix socket."""
+    host, separator, port = text.rpartition(":")
+    if separator and port.isdigit():
+        return host or "127.0.0.1", int(port)
+    return text
+
+
+def is_loopback(address: Address) -> bool:
+    """Whether only this machine can connect to `address`; Unix sockets are guarded by file permissions."""
+    if isinstance(address, str):
+        return True
+    try:
+        return all(ipaddress.ip_address(info[4][0]).is_loopback for info in socket.getaddrinfo(address[0], None))
+    except (OSError, ValueError):
+        return False
+
+
+class Coordinator:
+    """
+    Job-level proof-number search: the coordinator owns the top of a df-pn tree and hands its
+    frontier out to workers, each of which searches one position with a solver of its own.
+
+    The frontier is the unsolved leaves below the job node, most promising first, i.e. with the
+    smallest proof and disproof numbers. A job is the move sequence of a leaf (see `node_to_job`)
+    with an evaluation budget; the worker answers with the state of the position, its proof and
+    disproof numbers and its statistics. Results go into the leaf and up to the job node as if the
+    coordinator had searched the leaf itself, and proven positions into the transposition table.
+    A leaf a worker left unsolved is not handed out again; once every leaf was, the coordinator
+    grows its own tree by `top_evaluations`, which expands the most proving of them. Only when the
+    coordinator has nothing left to evaluate are searched leaves handed out again, each time with
+    twice the budget of the previous attempt.
+
+    Workers connect through `multiprocessing.connection` with `authkey`, so they may run on other
+    machines when the coordinator listens on a TCP address. Messages are pickled, so the key is all
+    that keeps others from running code in the coordinator and its workers: without one, a random
+    key is made for the local workers, and only a loopback address or a Unix socket is accepted. A
+    worker that disconnects has its job handed out again.
+    """
+
+    def __init__(self, solver: Solver, address: Address = ("127.0.0.1", 0), authkey: typing.Optional[bytes] = None,
+                 config: typing.Optional[WorkerConfig] = None, job_budget: int = 200, top_evaluations: int = 16):
+        if not isinstance(solver.tree, DFPN):
+            raise ValueError("The coordinator needs a solver in DFPN mode.")
+        if authkey is None:
+            if not is_loopback(address):
+                raise ValueError(f"Listening on {address} reaches other machines, which needs an authkey.")
+            authkey = secrets.token_bytes(32)
+        self.solver = solver
+        self.tree: DFPN = solver.tree
+        self.authkey = authkey
+        self.config = config or WorkerConfig()
+        self.job_budget = job_budget
+        self.top_evaluations = top_evaluations
+        self.workers: typing.Dict[str, WorkerStats] = {}
+        self.jobs = 0
+        self._listener = Listener(address, authkey=authkey)
+        self._connections: "queue.Queue[Connection]" = queue.Queue()
+        self._names: typing.Dict[Connection, str] = {}
+        self._idle: typing.Deque[Connection] = collections.deque()
+        # connection -> (job id, job, leaf)
+        self._busy: typing.Dict[Connection, typing.Tuple[int, str, SolverNode]] = {}
+        # completed jobs per leaf, keyed by `get_job`
+        self._attempts: typing.Dict[str, int] = {}
+        self._processes: typing.List[multiprocessing.process.BaseProcess] = []
+        self._closed = False
+        self._accept_thread = threading.Thread(target=self._accept, daemon=True)
+        self._accept_thread.start()
+
+    @property
+    def address(self) -> Address:
+        return self._listener.address
+
+    def start_local_workers(self, count: int):
+        """Start `count` worker processes on this machine."""
+        context = multiprocessing.get_context("spawn")
+        for i in range(count):
+            process = context.Process(target=run_worker, args=(self.address, self.authkey, f"local-{i}"), daemon=True)
+            process.start()
+            self._processes.append(process)
+
+    def solve(self, max_jobs: typing.Optional[int] = None, timeout: typing.Optional[float] = None) -> BoardState:
+        """
+        Search until the job node is solved, `max_jobs` jobs were handed out, `timeout` seconds
+        passed or the tree is exhausted, and return the state of the job node.
+        """
+        job_node = self.tree.get_job_node()
+        deadline = time.perf_counter() + timeout if timeout is not None else None
+        while job_node.status == BoardState.UNKNOWN:
+            if deadline is not None and time.perf_counter() >= deadline:
+                break
+            self._register_workers()
+            out_of_jobs = max_jobs is not None and self.jobs >= max_jobs
+            if self._idle and not out_of_jobs:
+                leaves = self._frontier(job_node)
+                if not leaves and not self._grow():
+                    leaves = self._frontier(job_node, searched=True)
+                    if not leaves and not self._busy:
+                        break  # nothing left to search
+                for leaf in leaves[:len(self._idle)]:
+                    self._dispatch(self._idle.popleft(), leaf)
+            elif out_of_jobs and not self._busy:
+                break
+            if self._busy:
+                for connection in wait(list(self._busy), timeout=0.1):
+                    self._receive(connection)
+            elif not self._idle:
+                self._wait_for_worker(0.1)
+        return job_node.status
+
+    def close(self):
+        """Stop the workers and the listener."""
+        for connection in list(self._names):
+            try:
+                connection.send({"type": "stop"})
+            except OSError:
+                pass
+            connection.close()
+        self._names.clear()
+        self._idle.clear()
+        self._busy.clear()
+        self._closed = True
+        self._listener.close()
+        for process in self._processes:
+            process.join(timeout=5)
+        self._processes.clear()
+
+    def __enter__(self) -> "Coordinator":
+        return self
+
+    def __exit__(self, exc_type, exc_val, exc_tb):
+        self.close()
+
+    def _accept(self):
+        while True:
+            try:
+                connection = self._listener.accept()
+            except (OSError, EOFError, multiprocessing.AuthenticationError):
+                if self._closed:
+                    return
+                continue  # e.g. a failed authentication
+            self._connections.put(connection)
+
+    def _register_workers(self):
+        while True:
+            try:
+                connection = self._connections.get_nowait()
+            except queue.Empty:
+                return
+            self._add_worker(connection)
+
+    def _wait_for_worker(self, timeout: float):
+        try:
+            connection = self._connections.get(timeout=timeout)
+        except queue.Empty:
+            return
+        self._add_worker(connection)
+
+    def _add_worker(self, connection: Connection):
+        try:
+            hello = connection.recv()
+            connection.send({"type": "config", "config": self.config})
+        except (OSError, EOFError):
+            connection.close()
+            return
+        name = hello.get("name") or f"worker-{len(self.workers)}"
+        self._names[connection] = name
+        self.workers.setdefault(name, WorkerStats())
+        self._idle.append(connection)
+
+    def _frontier(self, job_node: SolverNode, searched: bool = False) -> typing.List[SolverNode]:
+        """The unsolved leaves not being searched, and with `searched` those searched before as well."""
+        dispatched = set(id(leaf) for _, _, leaf in self._busy.values())
+        leaves = []
+        stack = [(job_node, 0)]
+        while stack:
+            node, depth = stack.pop()
+            if node.status != BoardState.UNKNOWN or id(node) in dispatched:
+                continue
+            if node.child is None and (searched or node.get_job() not in self._attempts):
+                leaves.append((min(node.proof_number, node.disproof_number), depth, len(leaves), node))
+            stack.extend((child, depth + 1) for child in node.get_children_iter())
+        leaves.sort()
+        return [leaf for _, _, _, leaf in leaves]
+
+    def _grow(self) -> bool:
+        """Search the top of the tree on the coordinator; returns False if nothing was left to evaluate."""
+        self.solver.solve(simulations=self.top_evaluations)
+        return self.tree.evaluations > 0
+
+    def _dispatch(self, connection: Connection, leaf: SolverNode):
+        job = "(" + node_to_job(leaf) + ")"
+        attempts = self._attempts.get(leaf.get_job(), 0)
+        self.jobs += 1
+        try:
+            connection.send({"type": "job", "id": self.jobs, "job": job, "budget": self.job_budget << attempts})
+        except OSError:
+            self._drop(connection)
+            return
+        self._busy[connection] = (self.jobs, job, leaf)
+
+    def _receive(self, connection: Connection):
+        try:
+            message = connection.recv()
+        except (OSError, EOFError):
+            self._drop(connection)
+            return
+        job_id, job, leaf = self._busy.pop(connection)
+        self._idle.append(connection)
+        if message.get("id") != job_id:
+            return
+        self._attempts[job[1:-1]] = self._attempts.get(job[1:-1], 0) + 1
+        stats = self.workers[self._names[connection]]
+        stats.jobs += 1
+        stats.evaluations += message["evaluations"]
+        stats.nodes += message["nodes"]
+        stats.seconds += message["seconds"]
+        state = BoardState(message["state"])
+        if "(" + node_to_job(leaf) + ")" != job:
+            return  # pruned from the tree meanwhile and reused
+        if state != BoardState.UNKNOWN:
+            stats.proven += 1
+        self._apply(leaf, state, message["proof_number"], message["disproof_number"])
+
+    def _apply(self, leaf: SolverNode, state: BoardState, proof_number: int, disproof_number: int):
+        tree = self.tree
+        if leaf.status != BoardState.UNKNOWN:
+            return
+        if state != BoardState.UNKNOWN:
+            leaf.proof_number, leaf.disproof_number = (0, PN_INFINITY) if state == BoardState.BLACK_WIN else (PN_INFINITY, 0)
+            tree._set_status(leaf)
+            tree.tt.store(node_to_position_key(leaf), leaf.proof_number, leaf.disproof_number)
+        elif leaf.child is None:
+            # the numbers of the worker's tree are a better estimate than (1, 1)
+            leaf.proof_number, leaf.disproof_number = max(proof_number, 1), max(disproof_number, 1)
+
+        job_node = tree.get_job_node()
+        node = leaf
+        stones = tree._count_stones(leaf)
+        while node is not job_node and node.parent is not None:
+            node = node.parent
+            stones -= 1
+            tree._update(node, tree._is_or_node(stones))
+
+    def _drop(self, connection: Connection):
+        self._busy.pop(connection, None)
+        if connection in self._idle:
+            self._idle.remove(connection)
+        self._names.pop(connection, None)
+        connection.close()
+
+
+def make_engine(config: WorkerConfig) -> NCTU6Engine:
+    if config.mock_decisive_rate is not None:
+        return MockNCTU6Engine(cache=EvaluationCache(), canonicalize=config.canonicalize,
+                               decisive_rate=config.mock_decisive_rate)
+    return NCTU6Engine(executable_path=config.executable_path, cache=EvaluationCache(), canonicalize=config.canonicalize)
+
+
+def run_worker(address: Address, authkey: bytes, name: typing.Optional[str] = None):
+    """
+    Connect to a coordinator and solve the jobs it sends until it stops or disconnects. The engine
+    and its cache live as long as the worker, so positions repeated across jobs are not evaluated
+    again.
+    """
+    connection = Client(address, authkey=authkey)
+    try:
+        connection.send({"type": "hello", "name": name or f"{socket.gethostname()}:{os.getpid()}"})
+        config: WorkerConfig = connection.recv()["config"]
+        engine = make_engine(config)
+        while True:
+            message = connection.recv()
+            if message["type"] != "job":
+                break
+            start = time.perf_counter()
+            solver = Solver(mode=config.mode, engine=engine)
+            solver.set_job(message["job"], reuse=False)
+            solver.solve(simulations=message["budget"])
+            node = solver.tree.job_node
+            connection.send({
+                "type": "result",
+                "id": message["id"],
+                "state": node.status.value,
+                "proof_number": node.proof_number,
+                "disproof_number": node.disproof_number,
+                "evaluations": solver.stats.evaluations,
+                "nodes": solver.tree.num_nodes,
+                "seconds": time.perf_counter() - start,
+            })
+    except (OSError, EOFError):
+        pass
+    finally:
+        connection.close()
@@ -1,8 +1,19 @@
 import abc
+import asyncio
+import os
 import typing
-from .solver_node import SolverNode
+from . import tracing
+from .book import OpeningBook
+from .cache import EvaluationCache
+from .solver_node import SolverNode, SolverNodeAllocator
+from .symmetry import INVERSE_SYMMETRY, canonicalize_job, transform_text
 from .types import BoardState, EvaluationResult
 
+try:
+    from . import coutput_parser
+except (ImportError, OSError, RuntimeError):
+    coutput_parser = None
+
 
 class Engine(abc.ABC):
     @abc.abstractmethod
@@ -13,22 +24,59 @@ class Engine(abc.ABC):
     async def evaluate_async(self, node: SolverNode, **kwargs) -> EvaluationResult:
         pass
 
+    def evaluate_batch(self, nodes: typing.Sequence[SolverNode],
+                       ignore_lists: typing.Optional[typing.Sequence[typing.Optional[str]]] = None) -> typing.List[EvaluationResult]:
+        """Evaluate `nodes`, node `i` with the `-ignore` list `ignore_lists[i]` if given, and return the results in order."""
+        if ignore_lists is None:
+            return [self.evaluate(node) for node in nodes]
+        return [self.evaluate(node) if ignore is None else self.evaluate(node, ignore=ignore)
+                for node, ignore in zip(nodes, ignore_lists)]
+
+    async def evaluate_batch_async(self, nodes: typing.Sequence[SolverNode],
+                                   ignore_lists: typing.Optional[typing.Sequence[typing.Optional[str]]] = None) -> typing.List[EvaluationResult]:
+        """Like `evaluate_batch`, for callers already running an event loop."""
+        if ignore_lists is None:
+            ignore_lists = [None] * len(nodes)
+        return list(await asyncio.gather(*(
+            self.evaluate_async(node) if ignore is None else self.evaluate_async(node, ignore=ignore)
+            for node, ignore in zip(nodes, ignore_lists))))
+
 
 class NCTU6Engine(Engine):
-    def __init__(self, executable_path: typing.Optional[str] = None):
+    def __init__(self, executable_path: typing.Optional[str] = None, cache: typing.Optional[EvaluationCache] = None,
+                 canonicalize: bool = False, book: typing.Optional[OpeningBook] = None,
+                 node_allocator: typing.Optional[SolverNodeAllocator] = None):
         self.executable_path = executable_path
+        self.cache = cache
+        self.canonicalize = canonicalize
+        # consulted before the cache and the engine, see `_lookup_book`
+        self.book = book
+        # allocates the nodes of the returned moves, shared with the search tree to recycle pruned nodes
+        self.node_allocator = node_allocator
+        # evaluations requested so far and engine processes currently running, read by `tracing.MetricsReporter`
+        self.evaluations = 0
+        self.pending = 0
+        # engine processes `evaluate_batch` runs at once
+        self.max_concurrency = os.cpu_count() or 1
 
     def _parse_result(self, output: str) -> EvaluationResult:
         from .utils import parse_nctu6_output, result_to_winrate
 
-        result_str, move_nodes, comments = parse_nctu6_output(output)
-
-        score = 0.0
-        if comments:
-            try:
-                score = result_to_winrate(comments[0])
-            except ValueError:
-                pass
+        # both parsers give the same fields, an unknown result label scores 0.0; the comments are
+        # split from the raw output only when asked for, see `EvaluationResult.comments`
+        if coutput_parser is not None:
+            parsed = coutput_parser.parse_output(output)
+            result_str = parsed.result
+            move_nodes = coutput_parser.moves_to_nodes(parsed.moves, self.node_allocator)
+            score = parsed.score
+        else:
+            result_str, move_nodes, comments = parse_nctu6_output(output, self.node_allocator)
+            score = 0.0
+            if comments:
+                try:
+                    score = float(result_to_winrate(comments[0]))
+                except ValueError:
+                    pass
 
         state = BoardState.UNKNOWN
         if score == 1.0:
@@ -40,38 +88,211 @@ class NCTU6Engine(Engine):
             moves=move_nodes,
             score=score,
             state=state,
-            info={"result": result_str, "comments": comments},
+            info={"result": result_str},
             raw=output
         )
 
+    @tracing.traced("evaluate", "engine")
     def evaluate(self, node: SolverNode, **kwargs) -> EvaluationResult:
-        from .utils import execute_nctu6, node_to_job
+        self.evaluations += 1
+        result = self._lookup_book(node, kwargs)
+        if result is not None:
+            return result
+        args, key, symmetry = self._prepare_job(node, kwargs)
+        if key is not None:
+            output = self.cache.get(key)
+            if output is not None:
+                return self._finish(output, symmetry)
 
-        job = node_to_job(node)
-        args = ["-playtsumego", job]
+        self.pending += 1
+        try:
+            output = self._execute(args)
+        finally:
+            self.pending -= 1
+
+        if key is not None and output:
+            self.cache.put(key, output)
+        return self._finish(output, symmetry)
+
+    @tracing.traced("evaluate_async", "engine")
+    async def evaluate_async(self, node: SolverNode, **kwargs) -> EvaluationResult:
+        self.evaluations += 1
+        result = self._lookup_book(node, kwargs)
+        if result is not None:
+            return result
+        args, key, symmetry = self._prepare_job(node, kwargs)
+        if key is not None:
+            output = self.cache.get(key)
+            if output is not None:
+                return self._finish(output, symmetry)
+
+        self.pending += 1
+        try:
+            output = await self._execute_async(args)
+        finally:
+            self.pending -= 1
+
+        if key is not None and output:
+            self.cache.put(key, output)
+        return self._finish(output, symmetry)
+
+    @tracing.traced("evaluate_batch", "engine")
+    def evaluate_batch(self, nodes: typing.Sequence[SolverNode],
+                       ignore_lists: typing.Optional[typing.Sequence[typing.Optional[str]]] = None) -> typing.List[EvaluationResult]:
+        """
+        Evaluate several nodes at once, e.g. a frontier of leaves. The book and the cache answer
+        first; of the remaining jobs, identical ones run once and all of them run concurrently
+        through `_execute_many`. Every node gets a result of its own, in order.
+
+        This runs its own event loop, from inside a running one use `evaluate_batch_async`.
+        """
+        results, jobs = self._plan_batch(nodes, ignore_lists)
+        if jobs:
+            self.pending += len(jobs)
+            try:
+                outputs = self._execute_many([list(args) for args in jobs])
+            finally:
+                self.pending -= len(jobs)
+            self._finish_batch(results, jobs, outputs)
+        return typing.cast(typing.List[EvaluationResult], results)
+
+    @tracing.traced("evaluate_batch_async", "engine")
+    async def evaluate_batch_async(self, nodes: typing.Sequence[SolverNode],
+                                   ignore_lists: typing.Optional[typing.Sequence[typing.Optional[str]]] = None) -> typing.List[EvaluationResult]:
+        """`evaluate_batch` on the running event loop, the jobs run through `_execute_many_async`."""
+        results, jobs = self._plan_batch(nodes, ignore_lists)
+        if jobs:
+            self.pending += len(jobs)
+            try:
+                outputs = await self._execute_many_async([list(args) for args in jobs])
+            finally:
+                self.pending -= len(jobs)
+            self._finish_batch(results, jobs, outputs)
+        return typing.cast(typing.List[EvaluationResult], results)
 
-        if "ignore" in kwargs:
-            args.extend(["-ignore", kwargs["ignore"]])
+    def _plan_batch(self, nodes: typing.Sequence[SolverNode],
+                    ignore_lists: typing.Optional[typing.Sequence[typing.Optional[str]]]):
+        """
+        Answer what the book and the cache can and group the rest by engine arguments, returning the
+        partial results and, for every distinct job, the (index, cache key, symmetry) of its nodes.
+        """
+        results: typing.List[typing.Optional[EvaluationResult]] = [None] * len(nodes)
+        # engine arguments -> (index, cache key, symmetry) of every node waiting for them
+        jobs: typing.Dict[typing.Tuple[str, ...], typing.List[typing.Tuple[int, typing.Optional[str], int]]] = {}
+        for i, node in enumerate(nodes):
+            self.evaluations += 1
+            ignore = ignore_lists[i] if ignore_lists is not None else None
+            kwargs = {"ignore": ignore} if ignore is not None else {}
+            result = self._lookup_book(node, kwargs)
+            if result is not None:
+                results[i] = result
+                continue
+            args, key, symmetry = self._prepare_job(node, kwargs)
+            if key is not None:
+                output = self.cache.get(key)
+                if output is not None:
+                    results[i] = self._finish(output, symmetry)
+                    continue
+            jobs.setdefault(tuple(args), []).append((i, key, symmetry))
+        return results, jobs
+
+    def _finish_batch(self, results: typing.List[typing.Optional[EvaluationResult]],
+                      jobs: typing.Dict[typing.Tuple[str, ...], typing.List[typing.Tuple[int, typing.Optional[str], int]]],
+                      outputs: typing.Sequence[str]):
+        for output, waiting in zip(outputs, jobs.values()):
+            key = waiting[0][1]
+            if key is not None and output:
+                self.cache.put(key, output)
+            for i, _, symmetry in waiting:
+                results[i] = self._finish(output, symmetry)
+
+    def _execute_many(self, args_list: typing.Sequence[typing.List[str]]) -> typing.List[str]:
+        """Run several jobs concurrently, at most `max_concurrency` engine processes at a time."""
+        try:
+            asyncio.get_running_loop()
+        except RuntimeError:
+            return asyncio.run(self._execute_many_async(args_list))
+        raise RuntimeError("evaluate_batch cannot run inside a running event loop, await evaluate_batch_async instead")
+
+    async def _execute_many_async(self, args_list: typing.Sequence[typing.List[str]]) -> typing.List[str]:
+        semaphore = asyncio.Semaphore(self.max_concurrency)
+
+        async def run(args: typing.List[str]) -> str:
+            async with semaphore:
+                return await self._execute_async(args)
+        return list(await asyncio.gather(*(run(args) for args in args_list)))
+
+    def _execute(self, args: typing.List[str]) -> str:
+        from .utils import execute_nctu6
 
         if self.executable_path:
-            output = execute_nctu6(args, executable=self.executable_path)
-        else:
-            output = execute_nctu6(args)
+            return execute_nctu6(args, executable=self.executable_path)
+        return execute_nctu6(args)
 
-        return self._parse_result(output)
+    async def _execute_async(self, args: typing.List[str]) -> str:
+        from .utils import execute_nctu6_async
 
-    async def evaluate_async(self, node: SolverNode, **kwargs) -> EvaluationResult:
-        from .utils import execute_nctu6_async, node_to_job
+        if self.executable_path:
+            return await execute_nctu6_async(args, executable=self.executable_path)
+        return await execute_nctu6_async(args)
+
+    def _lookup_book(self, node: SolverNode, kwargs: dict) -> typing.Optional[EvaluationResult]:
+        """
+        Answer from the opening book if it settles the question. A lost position is lost whatever
+        moves are ignored, a won one only answers if its winning stone is not among them.
+        """
+        if self.book is None:
+            return None
+        from .utils import get_stone_player, node_to_moves
+
+        moves = node_to_moves(node)
+        entry = self.book.lookup(moves)
+        if entry is None:
+            return None
+        side = get_stone_player(len(moves))
+        move_nodes = None
+        if entry.state == (BoardState.BLACK_WIN if side == "B" else BoardState.WHITE_WIN):
+            ignore = kwargs.get("ignore")
+            if ignore and (not entry.stones or f"{side}[{entry.stones[0]}]" in ignore.split(";")):
+                return None
+            for coords in reversed(entry.stones):
+                stone = self.node_allocator.allocate() if self.node_allocator is not None else SolverNode()
+                stone[side] = [coords]
+                if move_nodes is not None:
+                    stone.add_child(move_nodes)
+                move_nodes = stone
+        return EvaluationResult(
+            moves=move_nodes,
+            score=1.0 if entry.state == BoardState.BLACK_WIN else -1.0,
+            state=entry.state,
+            info={"result": "book"},
+            raw=""
+        )
+
+    def _prepare_job(self, node: SolverNode, kwargs: dict) -> typing.Tuple[typing.List[str], typing.Optional[str], int]:
+        """
+        Build the engine arguments and the cache key for `node`. With `canonicalize`, the job is
+        sent in its canonical orientation and the returned symmetry maps the output back.
+        """
+        from .utils import node_to_job
 
         job = node_to_job(node)
-        args = ["-playtsumego", job]
+        ignore = kwargs.get("ignore")
+        symmetry = 0
+        if self.canonicalize:
+            job, symmetry = canonicalize_job(job)
+            if ignore is not None:
+                ignore = transform_text(ignore, symmetry)
 
-        if "ignore" in kwargs:
-            args.extend(["-ignore", kwargs["ignore"]])
+        args = ["-playtsumego", job]
+        if ignore is not None:
+            args.extend(["-ignore", ignore])
 
-        if self.executable_path:
-            output = await execute_nctu6_async(args, executable=self.executable_path)
-        else:
-            output = await execute_nctu6_async(args)
+        key = None
+        if self.cache is not None:
+            key = EvaluationCache.make_key(job, ignore)
+        return args, key, symmetry
 
-        return self._parse_result(output)
+    def _finish(self, output: str, symmetry: int) -> EvaluationResult:
+        with tracing.span("parse_output", "engine"):
+            return self._parse_result(transform_text(output, INVERSE_SYMMETRY[symmetry]))
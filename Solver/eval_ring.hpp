@@ -0,0 +1,190 @@
+#pragma once
+
+#include "output_parser.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+constexpr uint64_t EVAL_RING_MAGIC = 0x31474e4952364343ull; // "CC6RING1"
+constexpr int EVAL_MAX_POINTS = NCTU6_BOARD_SIZE * NCTU6_BOARD_SIZE;
+constexpr size_t EVAL_MAX_OUTPUT = 2032;
+constexpr size_t EVAL_CACHE_LINE = 64;
+
+/**
+ * One evaluation job: the moves of the position followed by the ignored moves, packed like
+ * `NCTU6Output::moves`. A job and its ignore list never hold more stones than the board has points.
+ */
+struct EvalRequest {
+    uint64_t id;
+    uint16_t num_moves;
+    uint16_t num_ignore;
+    uint16_t points[EVAL_MAX_POINTS];
+};
+
+enum EvalStatus : uint32_t { EVAL_OK = 0, EVAL_ERROR = 1 };
+
+/**
+ * The engine output of a job, or the error message if running the engine failed. `length` is the
+ * size of the whole output; a longer output than `output` holds is cut and must not be used.
+ */
+struct EvalResponse {
+    uint64_t id;
+    uint32_t length;
+    uint32_t status;
+    char output[EVAL_MAX_OUTPUT];
+};
+
+/**
+ * Bounded multi-producer multi-consumer queue of fixed-size records over caller-provided memory,
+ * e.g. a shared-memory segment mapped by several processes (D. Vyukov's bounded queue).
+ *
+ * Every slot carries a sequence number telling producers and consumers whose turn it is, so a push
+ * or pop is one compare-and-swap on a shared position plus the copy of the record; nothing ever
+ * blocks or enters the kernel. The positions sit on cache lines of their own. Only lock-free
+ * 64-bit atomics live in the memory, which makes them safe across processes.
+ */
+class EvalRing {
+public:
+    static size_t bytes_required(size_t capacity, size_t record_size)
+    {
+        return sizeof(Header) + capacity * slot_size(record_size);
+    }
+
+    // Lay out an empty ring in `memory`; `capacity` must be a power of two.
+    static bool init(void* memory, size_t capacity, size_t record_size)
+    {
+        static_assert(std::atomic<uint64_t>::is_always_lock_free, "the ring needs lock-free 64-bit atomics");
+        if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+            return false;
+        }
+        Header* header = new (memory) Header;
+        header->capacity = capacity;
+        header->record_size = record_size;
+        header->enqueue_position.store(0, std::memory_order_relaxed);
+        header->dequeue_position.store(0, std::memory_order_relaxed);
+        header->closed.store(0, std::memory_order_relaxed);
+        EvalRing ring(memory);
+        for (size_t i = 0; i < capacity; ++i) {
+            new (ring.slot(i)) std::atomic<uint64_t>(i);
+        }
+        header->magic = EVAL_RING_MAGIC;
+        std::atomic_thread_fence(std::memory_order_release);
+        return true;
+    }
+
+    explicit EvalRing(void* memory) : header(static_cast<Header*>(memory)) {}
+
+    bool valid(size_t record_size) const
+    {
+        return header->magic == EVAL_RING_MAGIC && header->record_size == record_size;
+    }
+
+    size_t capacity() const
+    {
+        return header->capacity;
+    }
+
+    // Push up to `count` records stored back to back; returns how many fit.
+    size_t push(const void* records, size_t count)
+    {
+        const char* data = static_cast<const char*>(records);
+        size_t pushed = 0;
+        for (; pushed < count; ++pushed) {
+            uint64_t position = header->enqueue_position.load(std::memory_order_relaxed);
+            std::atomic<uint64_t>* sequence;
+            for (;;) {
+                sequence = slot(position);
+                int64_t difference = static_cast<int64_t>(sequence->load(std::memory_order_acquire) - position);
+                if (difference == 0) {
+                    if (header->enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                } else if (difference < 0) {
+                    return pushed; // full
+                } else {
+                    position = header->enqueue_position.load(std::memory_order_relaxed);
+                }
+            }
+            std::memcpy(record(sequence), data + pushed * header->record_size, header->record_size);
+            sequence->store(position + 1, std::memory_order_release);
+        }
+        return pushed;
+    }
+
+    // Pop up to `count` records into `records`, back to back; returns how many were taken.
+    size_t pop(void* records, size_t count)
+    {
+        char* data = static_cast<char*>(records);
+        size_t popped = 0;
+        for (; popped < count; ++popped) {
+            uint64_t position = header->dequeue_position.load(std::memory_order_relaxed);
+            std::atomic<uint64_t>* sequence;
+            for (;;) {
+                sequence = slot(position);
+                int64_t difference = static_cast<int64_t>(sequence->load(std::memory_order_acquire) - (position + 1));
+                if (difference == 0) {
+                    if (header->dequeue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                } else if (difference < 0) {
+                    return popped; // empty
+                } else {
+                    position = header->dequeue_position.load(std::memory_order_relaxed);
+                }
+            }
+            std::memcpy(data + popped * header->record_size, record(sequence), header->record_size);
+            sequence->store(position + header->capacity, std::memory_order_release);
+        }
+        return popped;
+    }
+
+    // Records pushed and not popped yet, exact only while nobody pushes or pops.
+    size_t size() const
+    {
+        return header->enqueue_position.load(std::memory_order_relaxed) - header->dequeue_position.load(std::memory_order_relaxed);
+    }
+
+    // Tell the consumers to stop, e.g. the adapter processes.
+    void close()
+    {
+        header->closed.store(1, std::memory_order_release);
+    }
+
+    bool closed() const
+    {
+        return header->closed.load(std::memory_order_acquire) != 0;
+    }
+
+private:
+    struct Header {
+        uint64_t magic;
+        uint64_t capacity;
+        uint64_t record_size;
+        alignas(EVAL_CACHE_LINE) std::atomic<uint64_t> enqueue_position;
+        alignas(EVAL_CACHE_LINE) std::atomic<uint64_t> dequeue_position;
+        alignas(EVAL_CACHE_LINE) std::atomic<uint64_t> closed;
+        char padding[EVAL_CACHE_LINE - sizeof(std::atomic<uint64_t>)];
+    };
+
+    Header* header;
+
+    // a slot is its sequence number followed by the record, rounded up to whole cache lines
+    static size_t slot_size(size_t record_size)
+    {
+        size_t size = sizeof(std::atomic<uint64_t>) + record_size;
+        return (size + EVAL_CACHE_LINE - 1) / EVAL_CACHE_LINE * EVAL_CACHE_LINE;
+    }
+
+    std::atomic<uint64_t>* slot(uint64_t position) const
+    {
+        char* slots = reinterpret_cast<char*>(header) + sizeof(Header);
+        return reinterpret_cast<std::atomic<uint64_t>*>(slots + (position & (header->capacity - 1)) * slot_size(header->record_size));
+    }
+
+    static char* record(std::atomic<uint64_t>* sequence)
+    {
+        return reinterpret_cast<char*>(sequence) + sizeof(std::atomic<uint64_t>);
+    }
+};
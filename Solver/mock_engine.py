@@ -0,0 +1,78 @@
+import hashlib
+import typing
+from .book import OpeningBook
+from .cache import EvaluationCache
+from .engine import NCTU6Engine
+from .solver_node import SolverNodeAllocator
+from .symmetry import MOVE_PATTERN, NUM_POINTS, coords_to_index, index_to_coords
+from .utils import get_stone_player
+
+# labels of undecided synthetic answers, decisive ones ("B:w", "W:w") are drawn with `decisive_rate`
+SYNTHETIC_LABELS = ["a-b:stable", "a-b:unstable", "a-b:B1", "a-b:w1", "a-b:B2", "a-b:w2", "B:a_w", "W:a_w"]
+
+
+class MockNCTU6Engine(NCTU6Engine):
+    """
+    Deterministic stand-in for NCTU6 that never starts a process.
+
+    Jobs found in `table` (an `EvaluationCache` recorded from real engine runs) are answered with
+    the recorded output. Any other job gets a synthetic answer derived from a hash of the job and
+    its ignore list: two empty points for the side to move and a result label, which is decisive
+    with probability `decisive_rate` so that the search can run its full budget. Everything else,
+    i.e. the opening book, caching, canonicalization and output parsing, runs exactly as in
+    `NCTU6Engine`.
+    """
+
+    def __init__(self, table: typing.Optional[EvaluationCache] = None, cache: typing.Optional[EvaluationCache] = None,
+                 canonicalize: bool = False, decisive_rate: float = 0.0, book: typing.Optional[OpeningBook] = None,
+                 node_allocator: typing.Optional[SolverNodeAllocator] = None):
+        super().__init__(cache=cache, canonicalize=canonicalize, book=book, node_allocator=node_allocator)
+        self.table = table
+        self.decisive_rate = decisive_rate
+        self.calls = 0
+
+    def _execute(self, args: typing.List[str]) -> str:
+        self.calls += 1
+        job = args[1]
+        ignore = args[3] if len(args) > 3 else None
+        if self.table is not None:
+            output = self.table.get(EvaluationCache.make_key(job, ignore))
+            if output is not None:
+                return output
+        return self.synthesize(job, ignore, self.decisive_rate)
+
+    async def _execute_async(self, args: typing.List[str]) -> str:
+        return self._execute(args)
+
+    def _execute_many(self, args_list: typing.Sequence[typing.List[str]]) -> typing.List[str]:
+        return [self._execute(args) for args in args_list]
+
+    @staticmethod
+    def synthesize(job: str, ignore: typing.Optional[str] = None, decisive_rate: float = 0.0) -> str:
+        moves = MOVE_PATTERN.findall(job)
+        occupied = set(coords_to_index(coords) for _, coords in moves)
+        if ignore:
+            occupied.update(coords_to_index(coords) for _, coords in MOVE_PATTERN.findall(ignore))
+        player = get_stone_player(len(moves))
+        # the rest of the current turn, i.e. one stone for the opening move or after a half turn
+        num_stones = 2 if get_stone_player(len(moves) + 1) == player else 1
+
+        digest = hashlib.sha256((job + "|" + (ignore or "")).encode()).digest()
+        draw = int.from_bytes(digest[-4:], "little") / (1 << 32)
+        if draw < decisive_rate:
+            label = "B:w" if digest[0] % 2 == 0 else "W:w"
+        else:
+            label = SYNTHETIC_LABELS[digest[0] % len(SYNTHETIC_LABELS)]
+
+        # linear probing from hashed start points, a full board leaves the answer without stones
+        stones = []
+        for i in range(1, len(digest), 2):
+            if len(stones) == num_stones or len(occupied) >= NUM_POINTS:
+                break
+            point = (digest[i] << 8 | digest[i + 1]) % NUM_POINTS
+            while point in occupied:
+                point = (point + 1) % NUM_POINTS
+            occupied.add(point)
+            stones.append(index_to_coords(point))
+
+        return "AB_RESULT " + "".join(f";{player}[{coords}]" for coords in stones) + f";C[{label}];C[0];C[mock];C[PV]\n"
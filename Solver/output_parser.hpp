@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+constexpr int NCTU6_BOARD_SIZE = 19;
+constexpr int NCTU6_MAX_MOVES = 8;
+constexpr uint16_t NCTU6_WHITE_FLAG = 0x8000;
+
+// Same order as `result_to_winrate` in utils.py
+constexpr const char* NCTU6_RESULT_LABELS[] = {
+    "B:w", "B:a_w", "a-b:B3", "a-b:B2", "a-b:B1", "a-b:stable",
+    "a-b:unstable", "a-b:w1", "a-b:w2", "a-b:w3", "W:a_w", "W:w"};
+constexpr double NCTU6_RESULT_SCORES[] = {
+    1.0, 0.9, 0.7, 0.5, 0.3, 0.0,
+    0.0, -0.3, -0.5, -0.7, -0.9, -1.0};
+constexpr int NCTU6_NUM_RESULT_LABELS = sizeof(NCTU6_RESULT_LABELS) / sizeof(NCTU6_RESULT_LABELS[0]);
+
+/**
+ * One line of NCTU6 output, e.g. `AB_RESULT ;W[IH];W[JH];C[B:a_w];C[...]`.
+ *
+ * Moves are packed as `y * NCTU6_BOARD_SIZE + x`, with `NCTU6_WHITE_FLAG` set for white stones.
+ * `label` is the index of the first comment in `NCTU6_RESULT_LABELS`, or -1 if it is unknown.
+ */
+struct NCTU6Output {
+    size_t result_length;
+    int num_moves;
+    uint16_t moves[NCTU6_MAX_MOVES];
+    int label;
+    double score;
+};
+
+class NCTU6OutputParser {
+public:
+    /**
+     * Parse the line starting at `begin` in a single pass without allocating.
+     * Returns a pointer past the end of the line (and its newline, if any).
+     */
+    static const char* parse_line(const char* begin, const char* end, NCTU6Output& output)
+    {
+        output.result_length = 0;
+        output.num_moves = 0;
+        output.label = -1;
+        output.score = 0.0;
+
+        const char* p = begin;
+        while (p < end && *p != ' ' && *p != '\n') {
+            ++p;
+        }
+        output.result_length = p - begin;
+
+        // moves: ;B[xy] or ;W[xy]
+        while (p < end && *p != '\n') {
+            if (*p == ' ') {
+                ++p;
+                continue;
+            }
+            if (end - p < 6 || p[0] != ';' || (p[1] != 'B' && p[1] != 'W') || p[2] != '[' || p[5] != ']') {
+                break;
+            }
+            int x = coordinate(p[3]);
+            int y = coordinate(p[4]);
+            if (x >= 0 && y >= 0 && output.num_moves < NCTU6_MAX_MOVES) {
+                uint16_t move = static_cast<uint16_t>(y * NCTU6_BOARD_SIZE + x);
+                output.moves[output.num_moves++] = p[1] == 'W' ? (move | NCTU6_WHITE_FLAG) : move;
+            }
+            p += 6;
+        }
+
+        // the first comment carries the result label
+        if (end - p >= 3 && p[0] == ';' && p[1] == 'C' && p[2] == '[') {
+            const char* label = p + 3;
+            const char* label_end = label;
+            while (label_end < end && *label_end != ']' && *label_end != '\n') {
+                ++label_end;
+            }
+            output.label = find_label(label, label_end - label);
+            if (output.label >= 0) {
+                output.score = NCTU6_RESULT_SCORES[output.label];
+            }
+            p = label_end;
+        }
+
+        while (p < end && *p != '\n') {
+            ++p;
+        }
+        return p < end ? p + 1 : p;
+    }
+
+    /**
+     * Parse a batch of outputs, e.g. the responses collected from several workers.
+     * Output `i` is `buffer[offsets[i]:offsets[i + 1]]`, so `offsets` holds `count + 1` entries.
+     */
+    static void parse_batch(const char* buffer, const size_t offsets[], size_t count, NCTU6Output outputs[])
+    {
+        for (size_t i = 0; i < count; ++i) {
+            parse_line(buffer + offsets[i], buffer + offsets[i + 1], outputs[i]);
+        }
+    }
+
+private:
+    static int coordinate(char c)
+    {
+        if (c >= 'A' && c < 'A' + NCTU6_BOARD_SIZE) {
+            return c - 'A';
+        }
+        if (c >= 'a' && c < 'a' + NCTU6_BOARD_SIZE) {
+            return c - 'a';
+        }
+        return -1;
+    }
+
+    static int find_label(const char* label, size_t length)
+    {
+        for (int i = 0; i < NCTU6_NUM_RESULT_LABELS; ++i) {
+            if (std::strlen(NCTU6_RESULT_LABELS[i]) == length && std::memcmp(NCTU6_RESULT_LABELS[i], label, length) == 0) {
+                return i;
+            }
+        }
+        return -1;
+    }
+};
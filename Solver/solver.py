@@ -1,20 +1,73 @@
+import time
 import typing
-from .engine import NCTU6Engine
+from . import checkpoint, tracing
+from .book import OpeningBook
+from .cache import EvaluationCache
+from .dfpn import DFPN
+from .engine import Engine, NCTU6Engine
+from .solver_node import SolverNodeAllocator
 from .tree import MCTS
-from .types import BoardState, EvaluationResult
-from .utils import node_to_move_string
+from .types import BoardState, EvaluationResult, SearchMode, SolverStats
 
 class Solver:
 
-    def __init__(self, executable_path: typing.Optional[str] = None):
-        self.engine = NCTU6Engine(executable_path=executable_path)
-        self.tree = MCTS()
+    def __init__(self, executable_path: typing.Optional[str] = None, mode: SearchMode = SearchMode.MCTS,
+                 cache: typing.Optional[EvaluationCache] = None, canonicalize: bool = False,
+                 engine: typing.Optional[Engine] = None, book: typing.Optional[OpeningBook] = None,
+                 max_nodes: typing.Optional[int] = None, checkpoint_path: typing.Optional[str] = None,
+                 checkpoint_interval: float = 600.0):
+        # `book` goes to the default engine, a given engine takes its own; the default engine also
+        # allocates its move nodes from the tree's allocator, which recycles pruned nodes
+        node_allocator = SolverNodeAllocator()
+        self.engine = engine or NCTU6Engine(executable_path=executable_path, cache=cache, canonicalize=canonicalize, book=book,
+                                            node_allocator=node_allocator)
+        self.mode = mode
+        if mode == SearchMode.MCTS:
+            self.tree = MCTS(node_allocator, max_nodes)
+        else:
+            self.tree = DFPN(self.engine, node_allocator=node_allocator, max_nodes=max_nodes)
+        self.stats = SolverStats()
+        # periodic checkpoints of the search state, taken between simulations or df-pn evaluations
+        self.checkpointer: typing.Optional[checkpoint.Checkpointer] = None
+        if checkpoint_path is not None:
+            self.checkpointer = checkpoint.Checkpointer(self, checkpoint_path, checkpoint_interval)
+            if mode == SearchMode.DFPN:
+                self.tree.before_evaluation = self.checkpointer.poll
 
-    def set_job(self, job: str):
+    def set_job(self, job: str, reuse: bool = True):
+        """
+        Set the position to solve. With `reuse`, a job continuing the moves of the current tree,
+        e.g. after moves were played in a game, keeps the search done below it (see `Tree.reroot`).
+        """
+        if reuse and self.tree.root is not None and self.tree.reroot(job):
+            return
         self.tree.load_sgf(job)
-        # set board state to solve
-        
-    def solve(self, simulations: int = 100):
+
+    def resume(self, path: str):
+        """Continue the search saved in the checkpoint at `path`, see `checkpoint.load`."""
+        checkpoint.load(self, path)
+
+    def checkpoint(self, path: typing.Optional[str] = None):
+        """
+        Write a checkpoint to `path`, or to the checkpoint path of the solver. The checkpoint is
+        written synchronously, after any periodic one still being written.
+        """
+        if path is None:
+            if self.checkpointer is None:
+                raise ValueError("No checkpoint path set.")
+            path = self.checkpointer.path
+        if self.checkpointer is not None:
+            self.checkpointer.wait()
+        checkpoint.write(self, path)
+
+    @tracing.traced("solve")
+    def solve(self, simulations: int = 100, batch_size: int = 1):
+        """
+        Run `simulations` MCTS simulations, or spend as many engine evaluations with df-pn. With a
+        `batch_size` above one, MCTS selects that many leaves at a time and evaluates them, with
+        their parents, in one `Engine.evaluate_batch` call (see `MCTS.select_batch`); df-pn always
+        evaluates one node at a time.
+        """
         # 1. tree select (MCTS)
         # 2. call NCTU6 
         # 3. expand tree
@@ -24,9 +77,31 @@ class Solver:
         if not self.tree.root:
             raise ValueError("No job set. Call set_job() first.")
 
+        stats = self.stats
+        if self.mode == SearchMode.DFPN:
+            # df-pn spends its budget on engine evaluations instead of simulations
+            start = time.perf_counter()
+            evaluate_seconds = self.tree.evaluate_seconds
+            self.tree.solve(max_evaluations=simulations)
+            evaluate_seconds = self.tree.evaluate_seconds - evaluate_seconds
+            stats.evaluations += self.tree.evaluations
+            stats.evaluate_seconds += evaluate_seconds
+            stats.select_seconds += time.perf_counter() - start - evaluate_seconds
+            return
+        if batch_size > 1:
+            self._solve_batched(simulations, batch_size)
+            return
+
         for i in range(simulations):
+            if self.checkpointer is not None:
+                self.checkpointer.poll()
+            stats.simulations += 1
             # 1. Selection (done)
+            t0 = time.perf_counter()
             leaf = self.tree.selection() 
+            t1 = time.perf_counter()
+            stats.select_seconds += t1 - t0
+            tracing.record("select", t0, t1)
             
             # If leaf is terminal (already solved), we treat it as a result
             if leaf.status != BoardState.UNKNOWN:
@@ -39,25 +114,101 @@ class Solver:
                     raw=""
                 )
                 self.tree.backpropagate(leaf, result)
+                t2 = time.perf_counter()
+                stats.backpropagate_seconds += t2 - t1
+                tracing.record("backpropagate", t1, t2)
                 continue
 
             # 2. Evaluation
             result = self.engine.evaluate(leaf)
+            t2 = time.perf_counter()
+            stats.evaluate_seconds += t2 - t1
+            stats.evaluations += 1
+            tracing.record("evaluate_leaf", t1, t2)
             par = leaf.parent
             if par:
-                # ignore_str = self.tree.collect_child_moves(par).to_sgf(root=NULL)
-                ignore_nodes = self.tree.collect_child_moves(par)
-                ignore_parts = [node_to_move_string(n) for n in ignore_nodes]
-                ignore_str = ";" + ";".join(ignore_parts)
+                ignore_str = par.get_child_moves_string()
                 result2 = self.engine.evaluate(par, ignore=ignore_str)
+                t3 = time.perf_counter()
                 self.tree.expand(par, result2)
+                t4 = time.perf_counter()
                 self.tree.backpropagate(par, result2)
+                t5 = time.perf_counter()
+                stats.evaluations += 1
+                stats.evaluate_seconds += t3 - t2
+                stats.expand_seconds += t4 - t3
+                stats.backpropagate_seconds += t5 - t4
+                tracing.record("evaluate_parent", t2, t3)
+                tracing.record("expand", t3, t4)
+                tracing.record("backpropagate", t4, t5)
+                t2 = t5
 
             # 3. Expansion
             self.tree.expand(leaf, result)
+            t3 = time.perf_counter()
             # 4. Backpropagation
             self.tree.backpropagate(leaf, result)
+            t4 = time.perf_counter()
+            stats.expand_seconds += t3 - t2
+            stats.backpropagate_seconds += t4 - t3
+            tracing.record("expand", t2, t3)
+            tracing.record("backpropagate", t3, t4)
             
             # Check if root is solved
             if self.tree.root.status != BoardState.UNKNOWN:
                 break
+
+    def _solve_batched(self, simulations: int, batch_size: int):
+        stats = self.stats
+        done = 0
+        while done < simulations:
+            if self.checkpointer is not None:
+                self.checkpointer.poll()
+            t0 = time.perf_counter()
+            leaves = self.tree.select_batch(min(batch_size, simulations - done))
+            t1 = time.perf_counter()
+            stats.select_seconds += t1 - t0
+            tracing.record("select", t0, t1)
+            done += len(leaves)
+            stats.simulations += len(leaves)
+
+            open_leaves = []
+            for leaf in leaves:
+                if leaf.status == BoardState.UNKNOWN:
+                    open_leaves.append(leaf)
+                    continue
+                score = 1.0 if leaf.status == BoardState.BLACK_WIN else -1.0
+                result = EvaluationResult(moves=None, score=score, state=leaf.status,
+                                          info={"comment": "Terminal node revisit"}, raw="")
+                self.tree.backpropagate(leaf, result)
+
+            # leaves sharing a parent ask for its other moves once
+            parents = list({id(leaf.parent): leaf.parent for leaf in open_leaves if leaf.parent}.values())
+            nodes = open_leaves + parents
+            ignore_lists = [None] * len(open_leaves) + [parent.get_child_moves_string() for parent in parents]
+            t2 = time.perf_counter()
+            results = self.engine.evaluate_batch(nodes, ignore_lists)
+            t3 = time.perf_counter()
+            stats.evaluations += len(nodes)
+            stats.evaluate_seconds += t3 - t2
+            tracing.record("evaluate_batch", t2, t3)
+
+            # the budget is enforced once the whole batch is in, pruning in between could release
+            # nodes whose results are still to be applied
+            for node, result in zip(parents + open_leaves, results[len(open_leaves):] + results[:len(open_leaves)]):
+                if node.parent is None and node is not self.tree.root:
+                    # released since it was selected
+                    continue
+                t4 = time.perf_counter()
+                self.tree.expand(node, result, enforce_budget=False)
+                t5 = time.perf_counter()
+                self.tree.backpropagate(node, result)
+                t6 = time.perf_counter()
+                stats.expand_seconds += t5 - t4
+                stats.backpropagate_seconds += t6 - t5
+                tracing.record("expand", t4, t5)
+                tracing.record("backpropagate", t5, t6)
+            self.tree.enforce_budget(self.tree.job_node)
+
+            if self.tree.root.status != BoardState.UNKNOWN or not leaves:
+                break
@@ -1,3 +1,4 @@
+import typing
 import sgf_tool
 from .types import BoardState
 
@@ -9,9 +10,91 @@ class SolverNode(sgf_tool.SGFNode):
         self.winrate: float = 0.0
         self.visit_count: int = 0
         self.status: BoardState = BoardState.UNKNOWN
+        # df-pn bookkeeping (see dfpn.py)
+        self.proof_number: int = 1
+        self.disproof_number: int = 1
+        self.expansions: int = 0
+        self.exhausted: bool = False
+        # generation stopped early, the moves not generated are unknown rather than losing
+        self.cut_off: bool = False
+        # cached engine strings, a node keeps its own move only (see get_job)
+        self._move: typing.Optional[str] = None
+        self._child_moves: typing.Optional[str] = None
+
+    def __setitem__(self, key, value):
+        super().__setitem__(key, value)
+        if key == "B" or key == "W":
+            self._move = None
+            if self.parent is not None:
+                self.parent._child_moves = None
+
+    def add_child(self, child):
+        super().add_child(child)
+        self._child_moves = None
+
+    def detach(self):
+        if self.parent is not None:
+            self.parent._child_moves = None
+        super().detach()
+        return self
+
+    def get_move_string(self) -> str:
+        """Return the move of this node, e.g. `B[JJ]`."""
+        if self._move is None:
+            player = "B" if "B" in self else "W"
+            if player not in self:
+                raise ValueError("Node does not contain a move.")
+            self._move = f"{player}[{self[player][0]}]"
+        return self._move
+
+    def get_job(self) -> str:
+        """
+        Return the moves from the root to this node, e.g. `;B[JJ];W[IH]`.
+
+        Nodes keep only their own move and the link to their parent, so a new node costs no copy
+        of the moves above it; the cached moves of the path are joined once, when the job is sent.
+        """
+        moves = []
+        ptr: typing.Optional[SolverNode] = self
+        while ptr is not None:
+            moves.append(ptr.get_move_string())
+            ptr = ptr.parent
+        moves.append("")
+        moves.reverse()
+        return ";".join(moves)
+
+    def get_child_moves_string(self) -> str:
+        """Return the moves of all children as an `-ignore` list, e.g. `;W[IH];W[JH]`."""
+        if self._child_moves is None:
+            self._child_moves = "".join(";" + child.get_move_string() for child in self.get_children_iter())
+        return self._child_moves
 
 
 class SolverNodeAllocator(sgf_tool.parser.NodeAllocator[SolverNode]):
+    """Allocates solver nodes, reusing the ones given back through `release` first."""
+
+    def __init__(self, max_free: int = 1 << 16):
+        self.max_free = max_free
+        self.free: typing.List[SolverNode] = []
 
     def allocate(self) -> SolverNode:
+        if self.free:
+            return self.free.pop()
         return SolverNode()
+
+    def release(self, node: SolverNode) -> int:
+        """
+        Take back the detached subtree of `node` and return its number of nodes. Every link is
+        cleared, so the nodes that are not kept for reuse are freed at once instead of waiting for
+        the cycle collector.
+        """
+        count = 0
+        stack = [node]
+        while stack:
+            node = stack.pop()
+            stack.extend(node.get_children_iter())
+            count += 1
+            SolverNode.__init__(node)
+            if len(self.free) < self.max_free:
+                self.free.append(node)
+        return count
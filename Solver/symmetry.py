@@ -0,0 +1,109 @@
+import re
+import typing
+
+BOARD_SIZE = 19
+NUM_POINTS = BOARD_SIZE * BOARD_SIZE
+NUM_SYMMETRIES = 8
+
+MOVE_PATTERN = re.compile(r"([BW])\[([A-Za-z]{2})\]")
+# a move with a lowercase coordinate, which `transform_text` uppercases
+LOWERCASE_MOVE_PATTERN = re.compile(r"[BW]\[(?:[a-z][A-Za-z]|[A-Z][a-z])\]")
+
+
+def _transform(x: int, y: int, symmetry: int) -> typing.Tuple[int, int]:
+    # bit 2 transposes, bit 0 mirrors the columns and bit 1 mirrors the rows
+    if symmetry & 4:
+        x, y = y, x
+    if symmetry & 1:
+        x = BOARD_SIZE - 1 - x
+    if symmetry & 2:
+        y = BOARD_SIZE - 1 - y
+    return x, y
+
+
+# TRANSFORM_TABLES[s][i] is the point index i mapped by symmetry s, with i = y * BOARD_SIZE + x
+TRANSFORM_TABLES: typing.List[typing.List[int]] = [
+    [y * BOARD_SIZE + x for x, y in (_transform(i % BOARD_SIZE, i // BOARD_SIZE, s) for i in range(NUM_POINTS))]
+    for s in range(NUM_SYMMETRIES)
+]
+
+INVERSE_SYMMETRY: typing.List[int] = [
+    next(t for t in range(NUM_SYMMETRIES) if all(TRANSFORM_TABLES[t][TRANSFORM_TABLES[s][i]] == i for i in range(NUM_POINTS)))
+    for s in range(NUM_SYMMETRIES)
+]
+
+
+def coords_to_index(coords: str) -> int:
+    x = ord(coords[0].upper()) - ord("A")
+    y = ord(coords[1].upper()) - ord("A")
+    return y * BOARD_SIZE + x
+
+
+def index_to_coords(index: int) -> str:
+    return chr(ord("A") + index % BOARD_SIZE) + chr(ord("A") + index // BOARD_SIZE)
+
+
+def transform_coords(coords: str, symmetry: int) -> str:
+    return index_to_coords(TRANSFORM_TABLES[symmetry][coords_to_index(coords)])
+
+
+def transform_moves(moves: typing.Iterable[typing.Tuple[str, str]], symmetry: int) -> typing.List[typing.Tuple[str, str]]:
+    table = TRANSFORM_TABLES[symmetry]
+    return [(player, index_to_coords(table[coords_to_index(coords)])) for player, coords in moves]
+
+
+def transform_bitboard(bitboard: int, symmetry: int) -> int:
+    """Transform a board stored as an integer with bit `i` set for every occupied point `i`."""
+    table = TRANSFORM_TABLES[symmetry]
+    result = 0
+    while bitboard:
+        lowest = bitboard & -bitboard
+        result |= 1 << table[lowest.bit_length() - 1]
+        bitboard ^= lowest
+    return result
+
+
+def transform_text(text: str, symmetry: int) -> str:
+    """
+    Transform every `B[..]`/`W[..]` move in an SGF fragment, e.g. a job or an engine output. The
+    moves come back uppercase whatever the symmetry, so transformed texts compare and cache alike.
+    """
+    if symmetry == 0:
+        if LOWERCASE_MOVE_PATTERN.search(text) is None:
+            return text
+        return MOVE_PATTERN.sub(lambda m: f"{m.group(1)}[{m.group(2).upper()}]", text)
+    return MOVE_PATTERN.sub(lambda m: f"{m.group(1)}[{transform_coords(m.group(2), symmetry)}]", text)
+
+
+def canonicalize_job(job: str) -> typing.Tuple[str, int]:
+    """
+    Return the smallest of the eight transformed jobs and the symmetry producing it.
+    Apply `INVERSE_SYMMETRY[symmetry]` to results obtained for the canonical job.
+    """
+    best, best_symmetry = transform_text(job, 0), 0
+    for symmetry in range(1, NUM_SYMMETRIES):
+        transformed = transform_text(job, symmetry)
+        if transformed < best:
+            best, best_symmetry = transformed, symmetry
+    return best, best_symmetry
+
+
+def canonical_position(moves: typing.Iterable[typing.Tuple[str, str]]) -> typing.Tuple[str, int]:
+    """
+    Return the key of `canonical_position_key` and a symmetry mapping the position onto the
+    canonical one. Points of the position map to the canonical orientation with that symmetry.
+    """
+    black = 0
+    white = 0
+    for player, coords in moves:
+        if player == "B":
+            black |= 1 << coords_to_index(coords)
+        else:
+            white |= 1 << coords_to_index(coords)
+    key, symmetry = min(((transform_bitboard(black, s), transform_bitboard(white, s)), s) for s in range(NUM_SYMMETRIES))
+    return f"{key[0]:x}/{key[1]:x}", symmetry
+
+
+def canonical_position_key(moves: typing.Iterable[typing.Tuple[str, str]]) -> str:
+    """Return a key shared by all symmetric positions, independent of move order."""
+    return canonical_position(moves)[0]
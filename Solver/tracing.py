@@ -0,0 +1,243 @@
+import asyncio
+import functools
+import inspect
+import itertools
+import json
+import os
+import threading
+import time
+import typing
+
+if typing.TYPE_CHECKING:
+    from .solver import Solver
+
+# (sequence, name, category, start, duration, thread id, args), times in `time.perf_counter` seconds
+Span = typing.Tuple[int, str, str, float, float, int, typing.Optional[dict]]
+
+
+class Tracer:
+    """
+    Fixed-size ring buffer of timestamped spans and counter samples.
+
+    Writers take a slot from the `itertools.count` of their ring, spans or counter samples, and store
+    one tuple there, both of which are atomic under the GIL, so recording never takes a lock. Once a
+    ring is full its oldest entries are overwritten. `export_chrome_trace` writes both rings in the
+    Chrome trace event format, which can be opened in chrome://tracing or Perfetto.
+    """
+
+    def __init__(self, capacity: int = 1 << 16):
+        self.capacity = capacity
+        self.origin = time.perf_counter()
+        self._slots: typing.List[typing.Optional[Span]] = [None] * capacity
+        self._counters: typing.List[typing.Optional[Span]] = [None] * capacity
+        # one sequence per ring, so that every slot of a ring is written in turn
+        self._span_sequence = itertools.count()
+        self._counter_sequence = itertools.count()
+
+    def record(self, name: str, start: float, end: float, category: str = "solver",
+               args: typing.Optional[dict] = None, tid: typing.Optional[int] = None):
+        """Record a span from `start` to `end`, both `time.perf_counter` values."""
+        sequence = next(self._span_sequence)
+        self._slots[sequence % self.capacity] = (
+            sequence, name, category, start, end - start, tid if tid is not None else threading.get_ident(), args)
+
+    def counter(self, name: str, values: typing.Dict[str, float], category: str = "metrics"):
+        sequence = next(self._counter_sequence)
+        self._counters[sequence % self.capacity] = (
+            sequence, name, category, time.perf_counter(), 0.0, threading.get_ident(), values)
+
+    def span(self, name: str, category: str = "solver", args: typing.Optional[dict] = None) -> "_Span":
+        return _Span(self, name, category, args)
+
+    def spans(self) -> typing.List[Span]:
+        """The spans still in the buffer, oldest first."""
+        return sorted((s for s in self._slots if s is not None), key=lambda s: s[0])
+
+    def export_chrome_trace(self, path: str):
+        pid = os.getpid()
+        events = []
+        for sequence, name, category, start, duration, tid, args in self.spans():
+            event = {"name": name, "cat": category, "ph": "X", "pid": pid, "tid": tid,
+                     "ts": (start - self.origin) * 1e6, "dur": duration * 1e6}
+            if args:
+                event["args"] = args
+            events.append(event)
+        for sequence, name, category, start, _, tid, values in sorted(
+                (s for s in self._counters if s is not None), key=lambda s: s[0]):
+            events.append({"name": name, "cat": category, "ph": "C", "pid": pid, "tid": tid,
+                           "ts": (start - self.origin) * 1e6, "args": values})
+        with open(path, "w") as f:
+            json.dump({"traceEvents": events, "displayTimeUnit": "ms"}, f)
+
+
+class _Span:
+    __slots__ = ("tracer", "name", "category", "args", "start")
+
+    def __init__(self, tracer: Tracer, name: str, category: str, args: typing.Optional[dict]):
+        self.tracer = tracer
+        self.name = name
+        self.category = category
+        self.args = args
+
+    def __enter__(self):
+        self.start = time.perf_counter()
+        return self
+
+    def __exit__(self, exc_type, exc_val, exc_tb):
+        self.tracer.record(self.name, self.start, time.perf_counter(), self.category, self.args)
+
+
+class _NullSpan:
+    __slots__ = ()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, exc_type, exc_val, exc_tb):
+        pass
+
+
+_NULL_SPAN = _NullSpan()
+_tracer: typing.Optional[Tracer] = None
+
+
+def enable(capacity: int = 1 << 16) -> Tracer:
+    """Start recording into a new process-wide tracer and return it."""
+    tracer = Tracer(capacity)
+    set_tracer(tracer)
+    return tracer
+
+
+def disable():
+    set_tracer(None)
+
+
+def set_tracer(tracer: typing.Optional[Tracer]):
+    """Make `tracer` the process-wide tracer, e.g. to resume recording into one paused by `disable`."""
+    global _tracer
+    _tracer = tracer
+
+
+def get_tracer() -> typing.Optional[Tracer]:
+    return _tracer
+
+
+def span(name: str, category: str = "solver", args: typing.Optional[dict] = None):
+    """Context manager recording a span on the active tracer, a shared no-op when tracing is off."""
+    tracer = _tracer
+    if tracer is None:
+        return _NULL_SPAN
+    return tracer.span(name, category, args)
+
+
+def record(name: str, start: float, end: float, category: str = "solver"):
+    """Record a span measured by the caller, for code that already takes `time.perf_counter` stamps."""
+    tracer = _tracer
+    if tracer is not None:
+        tracer.record(name, start, end, category)
+
+
+def traced(name: str, category: str = "solver"):
+    """
+    Decorator recording every call as a span. Calls of coroutine functions are recorded on a row
+    of their own task, since several of them overlap on the event loop thread.
+    """
+    def decorator(func):
+        if inspect.iscoroutinefunction(func):
+            @functools.wraps(func)
+            async def async_wrapper(*args, **kwargs):
+                tracer = _tracer
+                if tracer is None:
+                    return await func(*args, **kwargs)
+                start = time.perf_counter()
+                try:
+                    return await func(*args, **kwargs)
+                finally:
+                    tracer.record(name, start, time.perf_counter(), category, tid=id(asyncio.current_task()))
+            return async_wrapper
+
+        @functools.wraps(func)
+        def wrapper(*args, **kwargs):
+            tracer = _tracer
+            if tracer is None:
+                return func(*args, **kwargs)
+            start = time.perf_counter()
+            try:
+                return func(*args, **kwargs)
+            finally:
+                tracer.record(name, start, time.perf_counter(), category)
+        return wrapper
+    return decorator
+
+
+class MetricsReporter:
+    """
+    Background thread sampling a solver every `interval` seconds.
+
+    Each sample holds the evaluation rate, the number of engine calls in flight, the cache hit rate,
+    the tree size and the number of nodes pruned so far. Samples are appended to `path` as JSON
+    lines and, while tracing is enabled, recorded as counters so that they show up next to the
+    spans in the Chrome trace.
+    """
+
+    def __init__(self, solver: "Solver", path: typing.Optional[str] = None, interval: float = 1.0):
+        self.solver = solver
+        self.path = path
+        self.interval = interval
+        self.samples: typing.List[dict] = []
+        self._stop = threading.Event()
+        self._thread: typing.Optional[threading.Thread] = None
+        self._last_time = 0.0
+        self._last_evaluations = 0
+
+    def __enter__(self) -> "MetricsReporter":
+        self.start()
+        return self
+
+    def __exit__(self, exc_type, exc_val, exc_tb):
+        self.stop()
+
+    def start(self):
+        self._last_time = time.perf_counter()
+        self._last_evaluations = getattr(self.solver.engine, "evaluations", 0)
+        self._stop.clear()
+        self._thread = threading.Thread(target=self._run, daemon=True)
+        self._thread.start()
+
+    def stop(self):
+        if self._thread is None:
+            return
+        self._stop.set()
+        self._thread.join()
+        self._thread = None
+        self.sample()  # a final sample covering the tail of the run
+
+    def sample(self) -> dict:
+        engine = self.solver.engine
+        cache = getattr(engine, "cache", None)
+        now = time.perf_counter()
+        evaluations = getattr(engine, "evaluations", 0)
+        elapsed = now - self._last_time
+        lookups = cache.hits + cache.misses if cache is not None else 0
+        values = {
+            "evaluations_per_s": (evaluations - self._last_evaluations) / elapsed if elapsed > 0 else 0.0,
+            "queue_depth": getattr(engine, "pending", 0),
+            "cache_hit_rate": cache.hits / lookups if lookups else 0.0,
+            "tree_nodes": self.solver.tree.num_nodes,
+            "pruned_nodes": self.solver.tree.pruned_nodes,
+        }
+        self._last_time = now
+        self._last_evaluations = evaluations
+
+        self.samples.append(values)
+        tracer = _tracer
+        if tracer is not None:
+            tracer.counter("solver", values)
+        if self.path is not None:
+            with open(self.path, "a") as f:
+                f.write(json.dumps(dict(time=time.time(), **values)) + "\n")
+        return values
+
+    def _run(self):
+        while not self._stop.wait(self.interval):
+            self.sample()
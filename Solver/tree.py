@@ -2,19 +2,100 @@ import typing
 import math
 import random
 import sgf_tool
+from . import tracing
 from .solver_node import SolverNode, SolverNodeAllocator
 from .types import BoardState, EvaluationResult
 
 
 class Tree:
 
-    def __init__(self, node_allocator: typing.Optional[sgf_tool.parser.NodeAllocator[SolverNode]] = None):
+    def __init__(self, node_allocator: typing.Optional[SolverNodeAllocator] = None, max_nodes: typing.Optional[int] = None,
+                 prune_ratio: float = 0.75):
         self.node_allocator = node_allocator or SolverNodeAllocator()
         self.root: typing.Optional[SolverNode] = None
+        # the position to solve, the end of the main line of the loaded SGF
+        self.job_node: typing.Optional[SolverNode] = None
+        self.num_nodes = 0
+        # node budget, exceeding it prunes the tree down to `prune_ratio` of it (see `prune`)
+        self.max_nodes = max_nodes
+        self.prune_ratio = prune_ratio
+        self.prunes = 0
+        self.pruned_nodes = 0
 
     def load_sgf(self, sgf: str):
+        if self.root is not None:
+            self.node_allocator.release(self.root)
         self.root = sgf_tool.SGFParser(
             node_allocator=self.node_allocator).parse(sgf)
+        self.num_nodes = self.count_nodes(self.root)
+        self.job_node = self.root
+        while self.job_node is not None and self.job_node.child:
+            self.job_node = self.job_node.child
+
+    def reroot(self, sgf: str) -> bool:
+        """
+        Make the end of the main line of `sgf` the new job while keeping the search below it, e.g.
+        after moves were played. The moves of the new job that are already in the tree keep their
+        nodes and statistics, the others are appended. Every branch off the new main line is given
+        back to the node allocator. The nodes of the main line keep their own status and numbers:
+        their sides had other moves, so the result of the job node does not carry over to them.
+
+        Returns False, leaving the tree unchanged, if the tree is empty or starts with another move.
+        """
+        job = sgf_tool.SGFParser(node_allocator=self.node_allocator).parse(sgf)
+        if self.root is None or job is None or job.get_move_string() != self.root.get_move_string():
+            if job is not None:
+                self.node_allocator.release(job)
+            return False
+
+        node = self.root
+        move = job.child
+        while move is not None:
+            existing = self._find_child(node, move.get_move_string())
+            if existing is None:
+                # the rest of the job is new, its chain of nodes is taken as it is
+                node.add_child(move.detach())
+                self.num_nodes += self.count_nodes(move)
+                node = move
+                while node.child:
+                    node = node.child
+                break
+            node = existing
+            move = move.child
+        self.node_allocator.release(job)
+        self.job_node = node
+
+        # prune the branches off the path from the root to the new job node
+        child = node
+        ancestor = node.parent
+        while ancestor is not None:
+            for sibling in list(ancestor.get_children_iter()):
+                if sibling is not child:
+                    sibling.detach()
+                    self.num_nodes -= self.node_allocator.release(sibling)
+            child = ancestor
+            ancestor = ancestor.parent
+        return True
+
+    @staticmethod
+    def _find_child(node: SolverNode, move: str) -> typing.Optional[SolverNode]:
+        child = node.child
+        while child:
+            if child.get_move_string() == move:
+                return child
+            child = child.next_sibling
+        return None
+
+    @staticmethod
+    def count_nodes(node: typing.Optional[SolverNode]) -> int:
+        """Number of nodes in the subtree of `node`, including itself."""
+        count = 0
+        stack = [node] if node else []
+        while stack:
+            node = stack.pop()
+            count += 1
+            stack.extend(node.get_children_iter())
+        return count
 
     def collect_child_moves(self, node: SolverNode):
         child = node.child
@@ -24,7 +105,11 @@ class Tree:
             child = child.next_sibling
         return all_moves
 
-    def expand(self, node: SolverNode, result: EvaluationResult):
+    def expand(self, node: SolverNode, result: EvaluationResult, enforce_budget: bool = True):
+        """
+        Attach the moves of `result` below `node`. With `enforce_budget` False the tree may exceed
+        `max_nodes` until the caller calls `enforce_budget`, e.g. after a whole batch is applied.
+        """
         if result.state == BoardState.BLACK_WIN:
             node.status = BoardState.BLACK_WIN
         elif result.state == BoardState.WHITE_WIN:
@@ -40,6 +125,81 @@ class Tree:
 
             for move in moves:
                 node.add_child(move)
+                self.num_nodes += self.count_nodes(move)
+            if enforce_budget:
+                self.enforce_budget(node)
+
+    def enforce_budget(self, keep: typing.Optional[SolverNode]):
+        """Prune the tree if it exceeds `max_nodes`, sparing `keep`, its ancestors and its subtree."""
+        if self.max_nodes is not None and self.num_nodes > self.max_nodes:
+            self.prune(int(self.max_nodes * self.prune_ratio), keep)
+
+    @tracing.traced("prune")
+    def prune(self, target: int, keep: typing.Optional[SolverNode] = None) -> int:
+        """
+        Remove the least searched unsolved subtrees until at most `target` nodes are left and give
+        them back to the node allocator. Returns the number of nodes removed.
+
+        A subtree is searched by its visits (MCTS) plus the engine expansions within it (df-pn), and
+        subtrees holding a solved node are kept, as are the main line, `keep`, the ancestors of
+        `keep` and its subtree. Among equally searched subtrees the shallowest goes first.
+        """
+        if self.root is None or self.num_nodes <= target:
+            return 0
+        protected = set()
+        node = keep
+        while node is not None:
+            protected.add(id(node))
+            node = node.parent
+        node = self.job_node
+        while node is not None:
+            protected.add(id(node))
+            node = node.parent
+
+        # pre-order with depths, then subtree expansions and solved flags bottom-up
+        order: typing.List[typing.Tuple[SolverNode, int]] = []
+        stack = [(self.root, 0)]
+        while stack:
+            node, depth = stack.pop()
+            order.append((node, depth))
+            if node is not keep:
+                stack.extend((child, depth + 1) for child in node.get_children_iter())
+        expansions: typing.Dict[int, int] = {}
+        solved: typing.Set[int] = set()
+        candidates = []
+        for node, depth in reversed(order):
+            total = node.expansions + expansions.pop(id(node), 0)
+            if node.status != BoardState.UNKNOWN:
+                solved.add(id(node))
+            if id(node) in solved:
+                if node.parent is not None:
+                    solved.add(id(node.parent))
+            elif id(node) not in protected:
+                candidates.append((node.visit_count + total, depth, len(candidates), node))
+            if node.parent is not None:
+                expansions[id(node.parent)] = expansions.get(id(node.parent), 0) + total
+
+        removed = 0
+        candidates.sort()
+        for _, _, _, node in candidates:
+            if self.num_nodes <= target:
+                break
+            parent = node.parent
+            if parent is None:
+                continue  # inside a subtree removed already
+            node.detach()
+            count = self.node_allocator.release(node)
+            self.num_nodes -= count
+            removed += count
+            self._pruned_child(parent)
+        if removed:
+            self.prunes += 1
+            self.pruned_nodes += removed
+        return removed
+
+    def _pruned_child(self, parent: SolverNode):
+        """Called when a child of `parent` was pruned."""
+        pass
 
     def backpropagate(self, node: SolverNode, result: EvaluationResult):
         current = node
@@ -73,8 +233,8 @@ class Tree:
 
 class MCTS(Tree):
 
-    def __init__(self):
-        super().__init__()
+    def __init__(self, node_allocator: typing.Optional[SolverNodeAllocator] = None, max_nodes: typing.Optional[int] = None):
+        super().__init__(node_allocator, max_nodes)
         self.c = 1.41421356237
 
     def selection(self):
@@ -99,3 +259,28 @@ class MCTS(Tree):
             xd = xd.get_child(mxid)
         
         return xd
+
+    def select_batch(self, count: int) -> typing.List[SolverNode]:
+        """
+        Select up to `count` distinct leaves to evaluate together. Every selected path gets a
+        virtual visit, which steers the following selections to other leaves, and the virtual visits
+        are taken back before returning. Fewer leaves come back once the selection repeats itself.
+        """
+        leaves: typing.List[SolverNode] = []
+        selected = set()
+        for _ in range(count):
+            leaf = self.selection()
+            if id(leaf) in selected:
+                break
+            selected.add(id(leaf))
+            leaves.append(leaf)
+            node = leaf
+            while node:
+                node.visit_count += 1
+                node = node.parent
+        for leaf in leaves:
+            node = leaf
+            while node:
+                node.visit_count -= 1
+                node = node.parent
+        return leaves
@@ -19,3 +19,26 @@ class EvaluationResult:
     state: BoardState
     info: dict
     raw: str
+
+    @property
+    def comments(self) -> typing.List[str]:
+        """The comments of the raw engine output, the result label first; split on demand only."""
+        from .utils import split_nctu6_comments
+
+        return split_nctu6_comments(self.raw)
+
+
+class SearchMode(enum.Enum):
+    MCTS = 0
+    DFPN = 1
+
+
+@dataclass
+class SolverStats:
+    """Counters and wall-clock time per phase, accumulated over `Solver.solve` calls."""
+    simulations: int = 0
+    evaluations: int = 0
+    select_seconds: float = 0.0
+    evaluate_seconds: float = 0.0
+    expand_seconds: float = 0.0
+    backpropagate_seconds: float = 0.0
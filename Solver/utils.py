@@ -1,11 +1,14 @@
 import sgf_tool
+from . import tracing
 from .solver_node import SolverNode, SolverNodeAllocator
+from .symmetry import canonical_position_key
 import subprocess
 import os
 import asyncio
 import typing
 
 
+@tracing.traced("execute_nctu6", "engine")
 def execute_nctu6(command_args, *, executable=f"{os.path.dirname(os.path.abspath(__file__))}/../NCTU6/exec", working_dir=None):
     """Execute the NCTU6 executable with given command arguments.
 
@@ -42,6 +45,7 @@ def execute_nctu6(command_args, *, executable=f"{os.path.dirname(os.path.abspath
         raise RuntimeError(f"An error occurred: {e}") from e
 
 
+@tracing.traced("execute_nctu6_async", "engine")
 async def execute_nctu6_async(command_args, *, executable=f"{os.path.dirname(os.path.abspath(__file__))}/../NCTU6/exec", working_dir=None):
     """Execute the NCTU6 executable asynchronously with given command arguments.
 
@@ -98,6 +102,8 @@ def node_to_move_string(node: sgf_tool.SGFNode) -> str:
 
 
 def node_to_job(node: sgf_tool.SGFNode) -> str:
+    if isinstance(node, SolverNode):
+        return node.get_job()
     nodes = []
     ptr = node
     while ptr:
@@ -109,15 +115,54 @@ def node_to_job(node: sgf_tool.SGFNode) -> str:
     return job
 
 
-def parse_nctu6_output(output: str) -> typing.Tuple[str, SolverNode, typing.List[str]]:
-    result, remainder = output.split(" ", 1)
-    sgf_string = remainder[:12]
-    move_nodes = sgf_tool.SGFParser(
-        node_allocator=SolverNodeAllocator()).parse(f"({sgf_string})")
-    comments = remainder[12:].split("];C[")
-    comments[0] = comments[0][3:]
-    comments[-1] = comments[-1].strip()[:-1]
-    return result, move_nodes, comments
+def get_stone_player(index: int) -> str:
+    """Return the player of the `index`-th stone (0-based) of a Connect6 game.
+
+    Black opens with a single stone, after which both players place two stones per turn.
+    """
+    if index == 0:
+        return "B"
+    return "W" if ((index - 1) // 2) % 2 == 0 else "B"
+
+
+def node_to_moves(node: sgf_tool.SGFNode) -> typing.List[typing.Tuple[str, str]]:
+    moves = []
+    ptr = node
+    while ptr:
+        player = get_player(ptr)
+        moves.append((player, ptr[player][0]))
+        ptr = ptr.get_parent()
+    moves.reverse()
+    return moves
+
+
+def node_to_position_key(node: sgf_tool.SGFNode) -> str:
+    """Return a key identifying the board position at `node` up to symmetry, independent of move order."""
+    return canonical_position_key(node_to_moves(node))
+
+
+def parse_nctu6_output(output: str, node_allocator: typing.Optional[SolverNodeAllocator] = None
+                       ) -> typing.Tuple[str, typing.Optional[SolverNode], typing.List[str]]:
+    """Split an NCTU6 output into its result word, the chain of its moves (any number) and its comments."""
+    result, _, remainder = output.partition(" ")
+    start = remainder.find(";C[")
+    sgf_string = (remainder if start < 0 else remainder[:start]).replace(" ", "").strip()
+    move_nodes = None
+    if sgf_string:
+        move_nodes = sgf_tool.SGFParser(
+            node_allocator=node_allocator or SolverNodeAllocator()).parse(f"({sgf_string})")
+    return result, move_nodes, split_nctu6_comments(remainder)
+
+
+def split_nctu6_comments(output: str) -> typing.List[str]:
+    """Return the values of the `;C[...]` properties that end an NCTU6 output, the result label first."""
+    start = output.find(";C[")
+    if start < 0:
+        return []
+    comments = output[start + 3:].strip()
+    if comments.endswith("]"):
+        comments = comments[:-1]
+    return comments.split("];C[")
 
 
 def result_to_winrate(result: str) -> float:
@@ -0,0 +1,107 @@
+"""
+End-to-end solver benchmark against a deterministic mock NCTU6 engine.
+
+Usage:
+    python benchmark_solver.py [--simulations N] [--mode mcts|dfpn] [--table CACHE] [--decisive-rate P]
+                               [--label TEXT] [--memory] [--trace TRACE.json] [--metrics METRICS.jsonl]
+                               [--max-nodes N] [--batch-size N]
+
+`--table` replays outputs recorded by a real engine run with an `EvaluationCache` file; jobs missing
+from it get synthetic answers. `--memory` additionally measures the tree size with tracemalloc in a
+separate, untimed run. `--trace` writes a Chrome trace of the timed runs and `--metrics` appends
+periodic counter samples. `--max-nodes` bounds the search tree, which is pruned when it grows past
+the budget. `--batch-size` evaluates that many MCTS leaves per `Engine.evaluate_batch` call. One JSON
+object is printed per position.
+"""
+import argparse
+import json
+import os
+import sys
+import time
+import tracemalloc
+import typing
+
+# Ensure we can import from local directories
+sys.path.append(os.path.dirname(os.path.abspath(__file__)))
+
+from Solver import tracing
+from Solver.cache import EvaluationCache
+from Solver.mock_engine import MockNCTU6Engine
+from Solver.solver import Solver
+from Solver.types import SearchMode
+
+POSITIONS = [
+    "(;B[JJ];W[IH];W[HI];B[KK];B[LJ])",  # run_solver.py
+    "(;B[JJ];W[LH];W[HH];B[JI];B[KJ])",  # integrate_sgf_tool.py
+]
+
+
+def run(position: str, mode: SearchMode, simulations: int, table, decisive_rate: float,
+        metrics: typing.Optional[str] = None, max_nodes: typing.Optional[int] = None, batch_size: int = 1) -> Solver:
+    solver = Solver(mode=mode, engine=MockNCTU6Engine(table=table, decisive_rate=decisive_rate), max_nodes=max_nodes)
+    solver.set_job(position)
+    if metrics is None:
+        solver.solve(simulations=simulations, batch_size=batch_size)
+    else:
+        with tracing.MetricsReporter(solver, metrics):
+            solver.solve(simulations=simulations, batch_size=batch_size)
+    return solver
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--simulations", type=int, default=2000)
+    parser.add_argument("--mode", choices=["mcts", "dfpn"], default="mcts")
+    parser.add_argument("--table", default=None)
+    parser.add_argument("--decisive-rate", type=float, default=0.0)
+    parser.add_argument("--label", default="")
+    parser.add_argument("--memory", action="store_true")
+    parser.add_argument("--trace", default=None)
+    parser.add_argument("--metrics", default=None)
+    parser.add_argument("--max-nodes", type=int, default=None)
+    parser.add_argument("--batch-size", type=int, default=1)
+    args = parser.parse_args()
+
+    mode = SearchMode.MCTS if args.mode == "mcts" else SearchMode.DFPN
+    table = EvaluationCache(args.table) if args.table else None
+    tracer = tracing.enable() if args.trace else None
+
+    for position in POSITIONS:
+        start = time.perf_counter()
+        solver = run(position, mode, args.simulations, table, args.decisive_rate, args.metrics, args.max_nodes,
+                     args.batch_size)
+        seconds = time.perf_counter() - start
+        stats = solver.stats
+        report = {
+            "label": args.label,
+            "position": position,
+            "mode": args.mode,
+            "simulations": stats.simulations,
+            "evaluations": stats.evaluations,
+            "seconds": seconds,
+            "simulations_per_s": stats.simulations / seconds,
+            "evaluations_per_s": stats.evaluations / seconds,
+            "select_seconds": stats.select_seconds,
+            "evaluate_seconds": stats.evaluate_seconds,
+            "expand_seconds": stats.expand_seconds,
+            "backpropagate_seconds": stats.backpropagate_seconds,
+            "tree_nodes": solver.tree.num_nodes,
+            "pruned_nodes": solver.tree.pruned_nodes,
+            "status": solver.tree.job_node.status.name,
+        }
+        if args.memory:
+            tracing.disable()
+            tracemalloc.start()
+            before = tracemalloc.get_traced_memory()[0]
+            solver = run(position, mode, args.simulations, table, args.decisive_rate, max_nodes=args.max_nodes, batch_size=args.batch_size)
+            report["tree_bytes"] = tracemalloc.get_traced_memory()[0] - before
+            tracemalloc.stop()
+            tracing.set_tracer(tracer)
+        print(json.dumps(report), flush=True)
+
+    if tracer is not None:
+        tracer.export_chrome_trace(args.trace)
+
+
+if __name__ == "__main__":
+    main()
@@ -38,7 +38,7 @@ print(evaluation_result.raw.strip())
 # parse the NCTU6 output
 result = evaluation_result.info["result"]
 move_nodes = evaluation_result.moves
-comments = evaluation_result.info["comments"]
+comments = evaluation_result.comments
 
 # store ignore_str here because move_nodes will be modified later
 ignore_str = move_nodes.to_sgf(root=False)
@@ -65,7 +65,7 @@ print(evaluation_result.raw.strip())
 # parse the NCTU6 output
 result = evaluation_result.info["result"]
 move_nodes = evaluation_result.moves
-comments = evaluation_result.info["comments"]
+comments = evaluation_result.comments
 
 # store ignore_str here because move_nodes will be modified later
 ignore_str = move_nodes.to_sgf(root=False)
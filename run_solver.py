@@ -4,11 +4,16 @@ import os
 # Ensure we can import from local directories
 sys.path.append(os.path.dirname(os.path.abspath(__file__)))
 
+from Solver.book import OpeningBook, OpeningBookBuilder
 from Solver.solver import Solver
 from Solver.types import BoardState
 from Solver.utils import node_to_move_string, to_board_string
 
 def main():
+    # Optional opening book: consulted before the engine, and extended with the solved positions
+    book_path = sys.argv[1] if len(sys.argv) > 1 else None
+    book = OpeningBook(book_path) if book_path and os.path.exists(book_path) else None
+
     # Example SGF: 
     # Black places one stone at JJ.
     # White places two stones at IH, HI.
@@ -18,7 +23,7 @@ def main():
     
     print(f"Initializing solver with job: {input_sgf}")
     
-    solver = Solver()
+    solver = Solver(book=book)
     solver.set_job(input_sgf)
     
     # Run simulations
@@ -81,5 +86,14 @@ def main():
     else:
         print("\nNo valid moves found.")
 
+    if book_path:
+        builder = OpeningBookBuilder()
+        if book is not None:
+            builder.add_book(book)
+            book.close()
+        solved = builder.add_tree(solver.tree.job_node)
+        builder.write(book_path)
+        print(f"\nOpening book {book_path}: {solved} solved positions added, {len(builder)} entries.")
+
 if __name__ == "__main__":
     main()
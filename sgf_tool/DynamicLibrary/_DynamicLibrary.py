@@ -1,31 +1,52 @@
 """
 JIT-compiles C/C++ source into a shared library and exposes the exported
 symbols as Python callables with convenient type conversions.
+
+Libraries built ahead of time by ``python -m sgf_tool.DynamicLibrary.build``
+are loaded instead when their source digest matches, so that no compiler is
+needed at runtime.
 """
 
 from __future__ import annotations
 
 import getpass
 import hashlib
+import importlib.machinery
+import importlib.util
 import os
 import platform
 import shutil
 import subprocess
+import sys
+import sysconfig
 import tempfile
 import textwrap
 from pathlib import Path
+from types import ModuleType
 from typing import Dict, Iterable, List, Optional, Sequence, Tuple
 
 import ctypes  # pylint: disable=wrong-import-position
 
 from ._types import void  # type: ignore
 
-__all__ = ["DynamicLibrary", "CompileError", "FunctionWrapper"]
+__all__ = ["DynamicLibrary", "CompileError", "FunctionWrapper", "build_prebuilt"]
 
 _SYSTEM = platform.system()
 _IS_WINDOWS = _SYSTEM == "Windows"
 _LIB_EXT = {"Windows": ".dll", "Darwin": ".dylib"}.get(_SYSTEM, ".so")
 
+# Directory searched for ahead-of-time builds, see `build_prebuilt`.
+PREBUILT_DIR = Path(os.environ.get(
+    "DYNLIB_PREBUILT_DIR", Path(__file__).resolve().parent / "prebuilt"))
+
+# `-march` variants of ahead-of-time builds, best first, with the
+# /proc/cpuinfo flags a CPU needs to run them. The generic build is
+# always made and used when none of them is supported.
+MARCH_VARIANTS: Dict[str, Tuple[str, ...]] = {
+    "x86-64-v3": ("avx2", "bmi1", "bmi2", "fma", "f16c", "movbe", "abm"),
+    "x86-64-v2": ("sse4_2", "ssse3", "popcnt", "cx16"),
+}
+
 
 class CompileError(RuntimeError):
     """Raised when C/C++ compilation fails."""
@@ -122,7 +143,9 @@ class DynamicLibrary:
         cache_dir: str | os.PathLike | None = None,
         extra_compile_flags: Optional[Sequence[str]] = None,
     ) -> None:
-        self._compiler_cmd: Tuple[str, ...] = self._resolve_compiler(cc)
+        # resolved on first compile, prebuilt libraries need no compiler
+        self._cc = cc
+        self._compiler: Optional[Tuple[str, ...]] = None
         self._extra_flags = tuple(extra_compile_flags or ())
         if cache_dir is None:
             self._cache_dir = Path(tempfile.gettempdir()) / \
@@ -142,6 +165,16 @@ class DynamicLibrary:
                 "").dlclose  # type: ignore[attr-defined]
             self._dlclose.argtypes = [ctypes.c_void_p]
 
+    # sources of every library loaded so far, as (source, extra flags,
+    # digest), which is what `build_prebuilt` compiles
+    registry: List[Tuple[str, Tuple[str, ...], str]] = []
+
+    @property
+    def _compiler_cmd(self) -> Tuple[str, ...]:
+        if self._compiler is None:
+            self._compiler = self._resolve_compiler(self._cc)
+        return self._compiler
+
     # ---------------- context-manager ---------------- #
     def __enter__(self) -> "DynamicLibrary":
         return self
@@ -192,6 +225,28 @@ class DynamicLibrary:
             "\n" + _create_extractors(exports)
         self._build_and_load(full_source, functions or {})
 
+    def compile_extension(self, name: str, source: str) -> ModuleType:
+        """
+        Compile a CPython extension module and import it as `name`.
+
+        The source must define ``PyInit_<last component of name>``;
+        ``Python.h`` is on the include path. Prebuilt and cached builds
+        are looked up exactly like for `compile_string`.
+        """
+        include = sysconfig.get_paths()["include"]
+        if "-isystem" + include not in self._extra_flags:
+            self._extra_flags += ("-isystem" + include,)
+        # every interpreter ABI gets its own build
+        abi = f"// {sysconfig.get_config_var('SOABI') or sys.version}\n"
+        path = self._build(abi + "#define PY_SSIZE_T_CLEAN\n#include <Python.h>\n" + source)
+
+        loader = importlib.machinery.ExtensionFileLoader(name, str(path))
+        spec = importlib.util.spec_from_loader(name, loader, origin=str(path))
+        assert spec is not None
+        module = importlib.util.module_from_spec(spec)
+        loader.exec_module(module)
+        return module
+
     def compile_file(
         self,
         filepath: str | os.PathLike,
@@ -237,30 +292,60 @@ class DynamicLibrary:
     def _build_and_load(
         self, source: str, functions: Dict[str, Dict[str, object]]
     ) -> None:
-        # 1) check cache
+        self._lib_handle = ctypes.CDLL(str(self._build(source)))
+        self._bind_functions(functions)
+
+    def _build(self, source: str) -> Path:
+        """Return the path of a library built from `source`, compiling it if needed."""
+        # 1) prefer an ahead-of-time build of the same source
+        source_digest = self._source_digest(source)
+        DynamicLibrary.registry.append(
+            (source, self._extra_flags, source_digest))
+        prebuilt = _find_prebuilt(source_digest)
+        if prebuilt is not None:
+            return prebuilt
+
+        # 2) check cache
         digest = hashlib.sha256(
             (
-                source
-                + "|cmd="  # ensure different flag sets map differently
+                source_digest
+                + "|cmd="  # ensure different compilers map differently
                 + " ".join(self._compiler_cmd)
-                + " ".join(self._extra_flags)
             ).encode()
         ).hexdigest()
         cached_lib = self._cache_dir / f"lib_{digest}{_LIB_EXT}"
         if not cached_lib.exists():
-            # 2) Compile into temp dir
+            # 3) Compile into temp dir
             self._tmp_dir_ctx = tempfile.TemporaryDirectory()
             self._tmp_dir_path = Path(self._tmp_dir_ctx.name)
             src_path = self._tmp_dir_path / "lib.cpp"
             src_path.write_text(source, encoding="utf-8")
 
             self._compile(src_path, cached_lib)
-        # 3) Load
-        self._lib_handle = ctypes.CDLL(str(cached_lib))
-        self._bind_functions(functions)
+        return cached_lib
+
+    def _source_digest(self, source: str) -> str:
+        """
+        Hash the source, the flags and every header in the `-I`
+        directories, so that editing an included header rebuilds too.
+        """
+        h = hashlib.sha256(source.encode())
+        h.update(("|flags=" + " ".join(self._extra_flags)).encode())
+        for flag in self._extra_flags:
+            if not flag.startswith("-I"):
+                continue
+            for header in sorted(Path(flag[2:]).glob("*.h*")):
+                h.update(header.name.encode())
+                h.update(header.read_bytes())
+        return h.hexdigest()
 
     # ---------- compiler invocation ---------- #
-    def _compile(self, src_path: Path, output_path: Path) -> None:
+    def _compile(
+        self,
+        src_path: Path,
+        output_path: Path,
+        optimize_flags: Sequence[str] = ("-O3", "-g"),
+    ) -> None:
         cmd = list(self._compiler_cmd)
 
         # Windows/MSC uses different flags
@@ -269,8 +354,8 @@ class DynamicLibrary:
             cmd += ["/LD", str(src_path), f"/Fe:{output_path}"]
         else:
             # GCC/Clang
-            cmd += [str(src_path), "-shared", "-o",
-                    str(output_path), "-O3", "-g"]
+            cmd += [str(src_path), "-shared", "-o", str(output_path)]
+            cmd.extend(optimize_flags)
             if not _IS_WINDOWS:
                 cmd.append("-fPIC")
             cmd.extend(self._extra_flags)
@@ -328,6 +413,75 @@ class DynamicLibrary:
         raise FileNotFoundError("No suitable C/C++ compiler found on PATH.")
 
 
+# Helpers – ahead-of-time builds                                            #
+def _prebuilt_name(digest: str, variant: str = "") -> str:
+    return f"lib_{digest}{'.' + variant if variant else ''}{_LIB_EXT}"
+
+
+_cpu_flags: Optional[set] = None
+
+
+def _supported_variants() -> List[str]:
+    global _cpu_flags
+    if _cpu_flags is None:
+        _cpu_flags = set()
+        try:
+            with open("/proc/cpuinfo", encoding="utf-8") as fp:
+                for line in fp:
+                    if line.startswith("flags"):
+                        _cpu_flags = set(line.partition(":")[2].split())
+                        break
+        except OSError:
+            pass
+    return [variant for variant, flags in MARCH_VARIANTS.items()
+            if _cpu_flags.issuperset(flags)]
+
+
+def _find_prebuilt(digest: str) -> Optional[Path]:
+    if not PREBUILT_DIR.is_dir():
+        return None
+    for variant in _supported_variants() + [""]:
+        path = PREBUILT_DIR / _prebuilt_name(digest, variant)
+        if path.exists():
+            return path
+    return None
+
+
+def build_prebuilt(
+    output_dir: str | os.PathLike | None = None,
+    variants: Optional[Sequence[str]] = None,
+    lto: bool = True,
+    cc: str | Sequence[str] = "auto",
+) -> List[Path]:
+    """
+    Compile every library in `DynamicLibrary.registry` ahead of time:
+    one generic build and one per `-march` variant in `variants`
+    (all of `MARCH_VARIANTS` by default), with link-time optimization.
+    Returns the paths written.
+    """
+    output = Path(output_dir) if output_dir is not None else PREBUILT_DIR
+    output.mkdir(parents=True, exist_ok=True)
+    if variants is None:
+        variants = list(MARCH_VARIANTS) if not _IS_WINDOWS else []
+    flags = ["-O3", "-flto"] if lto else ["-O3"]
+
+    # a library loaded more than once is built once
+    sources = {digest: (source, extra_flags)
+               for source, extra_flags, digest in DynamicLibrary.registry}
+    written = []
+    for digest, (source, extra_flags) in sources.items():
+        builder = DynamicLibrary(cc, extra_compile_flags=extra_flags)
+        with tempfile.TemporaryDirectory() as tmp:
+            src_path = Path(tmp) / "lib.cpp"
+            src_path.write_text(source, encoding="utf-8")
+            for variant in [""] + list(variants):
+                path = output / _prebuilt_name(digest, variant)
+                march = [f"-march={variant}"] if variant else []
+                builder._compile(src_path, path, flags + march)
+                written.append(path)
+    return written
+
+
 # Helper – generate extractor functions                                    #
 _EXTRACTOR_FMT = (
     r"void* __get_library_function_pointer_{0}() {{ "
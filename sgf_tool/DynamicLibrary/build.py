@@ -0,0 +1,42 @@
+"""
+Build the native libraries of the project ahead of time.
+
+Usage:
+    python -m sgf_tool.DynamicLibrary.build [--output DIR] [--march VARIANT ...] [--no-lto] [MODULE ...]
+
+Every module listed (by default all modules with native code) is imported once, which registers
+its library source, and each source is then compiled with link-time optimization into a generic
+build plus one build per `-march` variant. The output defaults to `PREBUILT_DIR`, where
+`DynamicLibrary` looks before compiling anything itself; set DYNLIB_PREBUILT_DIR at runtime to use
+another directory. A prebuilt library is only used while its source digest still matches.
+"""
+import argparse
+import importlib
+import os
+import sys
+
+from ._DynamicLibrary import MARCH_VARIANTS, PREBUILT_DIR, build_prebuilt
+
+MODULES = ["sgf_tool.cparser", "sgf_tool.clexer", "sgf_tool.cnative", "Solver.coutput_parser", "Solver.ceval_ring"]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("modules", nargs="*", default=MODULES)
+    parser.add_argument("--output", default=str(PREBUILT_DIR))
+    parser.add_argument("--march", nargs="*", default=None, choices=list(MARCH_VARIANTS),
+                        help="-march variants to build in addition to the generic build (default: all)")
+    parser.add_argument("--no-lto", action="store_true")
+    args = parser.parse_args()
+
+    # the project root, so that `Solver` imports from a source checkout
+    sys.path.insert(0, os.path.dirname(os.path.dirname(os.path.dirname(os.path.abspath(__file__)))))
+    for module in args.modules:
+        importlib.import_module(module)
+
+    for path in build_prebuilt(args.output, variants=args.march, lto=not args.no_lto):
+        print(path)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,288 @@
+/**
+ * Benchmarks for SGFLexer, SGFParser and SGFTreeSerializer on synthetic corpora.
+ *
+ * Build:  g++ -O3 -std=c++17 sgf_tool/benchmark/bench_sgf.cpp -o bench_sgf
+ *         (add -DSGF_INSTRUMENTATION=1 to also report the lexer and parser counters)
+ * Usage:  bench_sgf [--scale N] [--repeat N] [--label TEXT] [--case NAME] [--kernel LEVEL] [--write-corpus DIR]
+ *
+ * `--kernel` (scalar, sse2, avx2 or avx512) caps the lexer kernels below the best level of the host.
+ *
+ * Each case runs in its own forked process, so the reported peak RSS belongs to that case only.
+ * Results are printed as one JSON object per line, tagged with `--label` (e.g. a commit hash).
+ */
+#include "../parser.hpp"
+#include "../serializer.hpp"
+#include "corpus.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+static std::atomic<size_t> allocation_count{0};
+
+void* operator new(size_t size)
+{
+    ++allocation_count;
+    if (void* p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+struct BenchmarkCase {
+    std::string name;
+    std::vector<std::string> documents;
+};
+
+struct BenchmarkResult {
+    size_t bytes = 0;
+    size_t nodes = 0;
+    size_t tokens = 0;
+    size_t parse_allocations = 0;
+    double lex_seconds = 0;
+    double parse_seconds = 0;
+    double serialize_seconds = 0;
+    SGFStatistics statistics;
+};
+
+static const std::vector<std::string> case_names = {"deep_linear", "wide", "comment_heavy", "small_documents"};
+
+static BenchmarkCase make_case(const std::string& name, size_t scale)
+{
+    SGFCorpusGenerator generator;
+    if (name == "deep_linear") {
+        return {name, {generator.deep_linear(200000 * scale)}};
+    }
+    if (name == "wide") {
+        return {name, {generator.wide(20000 * scale)}};
+    }
+    if (name == "comment_heavy") {
+        return {name, {generator.comment_heavy(20000 * scale, 512)}};
+    }
+    return {name, generator.small_documents(20000 * scale)};
+}
+
+// Run `func` `repeat` times and return the fastest run in seconds.
+static double best_of(int repeat, const std::function<void()>& func)
+{
+    double best = 0;
+    for (int i = 0; i < repeat; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        func();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (i == 0 || seconds < best) {
+            best = seconds;
+        }
+    }
+    return best;
+}
+
+static StringSGFNode* parse_document(const std::string& sgf, TrackingNodeAllocator<StringSGFNode>& allocator, SGFStatistics* statistics = nullptr)
+{
+    SGFParser parser(sgf, allocator);
+    auto root = static_cast<StringSGFNode*>(parser.next_node());
+    while (parser.next_node() != nullptr);
+    if (statistics != nullptr) {
+        SGFStatistics stats = parser.statistics();
+        for (size_t i = 0; i < SGF_NUM_TOKEN_TYPES; ++i) {
+            statistics->token_counts[i] += stats.token_counts[i];
+        }
+        statistics->value_bytes += stats.value_bytes;
+        statistics->structure_bytes += stats.structure_bytes;
+        statistics->node_allocations += stats.node_allocations;
+        statistics->max_stack_depth = std::max(statistics->max_stack_depth, stats.max_stack_depth);
+        statistics->lex_seconds += stats.lex_seconds;
+        statistics->parse_seconds += stats.parse_seconds;
+    }
+    return root;
+}
+
+static BenchmarkResult run_case(const BenchmarkCase& c, int repeat)
+{
+    BenchmarkResult result;
+    for (const std::string& sgf : c.documents) {
+        result.bytes += sgf.size();
+    }
+
+    result.lex_seconds = best_of(repeat, [&]() {
+        result.tokens = 0;
+        for (const std::string& sgf : c.documents) {
+            SGFLexer lexer(sgf);
+            while (lexer.next_token().type != SGFTokenType::ENDOFFILE) {
+                ++result.tokens;
+            }
+        }
+    });
+
+    result.parse_seconds = best_of(repeat, [&]() {
+        result.nodes = 0;
+        size_t allocations = 0;
+        for (const std::string& sgf : c.documents) {
+            TrackingNodeAllocator<StringSGFNode> allocator;
+            size_t before = allocation_count.load();
+            parse_document(sgf, allocator);
+            allocations += allocation_count.load() - before;
+            result.nodes += allocator.getAllocatedNodes().size();
+            allocator.deallocateAll();
+        }
+        result.parse_allocations = allocations;
+    });
+
+    // parse once up front, only the serialization itself is timed
+    std::vector<TrackingNodeAllocator<StringSGFNode>> allocators(c.documents.size());
+    std::vector<StringSGFNode*> roots;
+    size_t string_size = 0;
+    size_t num_tag_value = 0;
+    size_t max_nodes = 0;
+    for (size_t i = 0; i < c.documents.size(); ++i) {
+        roots.push_back(parse_document(c.documents[i], allocators[i], &result.statistics));
+        for (auto* node : allocators[i].getAllocatedNodes()) {
+            string_size += node->content.size();
+            num_tag_value += node->tag_value_sizes.size();
+        }
+        max_nodes = std::max(max_nodes, allocators[i].getAllocatedNodes().size());
+    }
+    std::vector<char> tag_value_string(string_size);
+    std::vector<size_t> tag_value_sizes(num_tag_value);
+    std::vector<char> is_tag(num_tag_value);
+    std::vector<size_t> tag_value_count(max_nodes);
+    std::vector<size_t> parent_indices(max_nodes);
+    result.serialize_seconds = best_of(repeat, [&]() {
+        for (StringSGFNode* root : roots) {
+            SGFTreeSerializer::serialize(root, tag_value_string.data(), tag_value_sizes.data(), is_tag.data(), tag_value_count.data(), parent_indices.data());
+        }
+    });
+    for (auto& allocator : allocators) {
+        allocator.deallocateAll();
+    }
+    return result;
+}
+
+static long peak_rss_kb()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static void print_result(const std::string& label, const BenchmarkCase& c, const BenchmarkResult& r)
+{
+    double mb = r.bytes / 1e6;
+    std::printf(
+        "{\"label\": \"%s\", \"case\": \"%s\", \"kernel\": \"%s\", \"documents\": %zu, \"bytes\": %zu, \"nodes\": %zu, \"tokens\": %zu, "
+        "\"lex_mb_per_s\": %.3f, \"parse_mb_per_s\": %.3f, \"parse_nodes_per_s\": %.1f, "
+        "\"serialize_mb_per_s\": %.3f, \"serialize_nodes_per_s\": %.1f, "
+        "\"allocations_per_node\": %.3f, \"peak_rss_kb\": %ld}\n",
+        label.c_str(), c.name.c_str(), SGFKernels::level_name(SGFKernels::level()), c.documents.size(), r.bytes, r.nodes, r.tokens,
+        mb / r.lex_seconds, mb / r.parse_seconds, r.nodes / r.parse_seconds,
+        mb / r.serialize_seconds, r.nodes / r.serialize_seconds,
+        r.nodes ? static_cast<double>(r.parse_allocations) / r.nodes : 0.0, peak_rss_kb());
+    if constexpr (SGF_INSTRUMENTATION_ENABLED) {
+        const SGFStatistics& s = r.statistics;
+        std::printf(
+            "{\"label\": \"%s\", \"case\": \"%s\", \"tag_tokens\": %zu, \"value_tokens\": %zu, \"value_bytes\": %zu, "
+            "\"structure_bytes\": %zu, \"node_allocations\": %zu, \"max_stack_depth\": %zu, "
+            "\"lex_seconds\": %.6f, \"parse_seconds\": %.6f}\n",
+            label.c_str(), c.name.c_str(), s.token_counts[static_cast<int>(SGFTokenType::TAG)],
+            s.token_counts[static_cast<int>(SGFTokenType::VALUE)], s.value_bytes, s.structure_bytes,
+            s.node_allocations, s.max_stack_depth, s.lex_seconds, s.parse_seconds);
+    }
+    std::fflush(stdout);
+}
+
+static void write_corpus(const std::string& directory, size_t scale)
+{
+    // one document per line
+    for (const std::string& name : case_names) {
+        BenchmarkCase c = make_case(name, scale);
+        std::ofstream out(directory + "/" + name + ".sgf", std::ios::binary);
+        for (const std::string& sgf : c.documents) {
+            out << sgf << '\n';
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    size_t scale = 1;
+    int repeat = 3;
+    std::string label;
+    std::string only_case;
+    std::string corpus_directory;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << std::endl;
+            return 2;
+        }
+        if (arg == "--scale") {
+            scale = std::stoul(argv[++i]);
+        } else if (arg == "--repeat") {
+            repeat = std::stoi(argv[++i]);
+        } else if (arg == "--label") {
+            label = argv[++i];
+        } else if (arg == "--case") {
+            only_case = argv[++i];
+        } else if (arg == "--kernel") {
+            std::string name = argv[++i];
+            SGFKernelLevel level = SGFKernelLevel::SCALAR;
+            for (int l = 0; l <= static_cast<int>(SGFKernelLevel::AVX512); ++l) {
+                if (name == SGFKernels::level_name(static_cast<SGFKernelLevel>(l))) {
+                    level = static_cast<SGFKernelLevel>(l);
+                }
+            }
+            SGFKernels::select(level);
+        } else if (arg == "--write-corpus") {
+            corpus_directory = argv[++i];
+        } else {
+            std::cerr << "Unknown argument " << arg << std::endl;
+            return 2;
+        }
+    }
+
+    if (!corpus_directory.empty()) {
+        write_corpus(corpus_directory, scale);
+        return 0;
+    }
+
+    int status = 0;
+    for (const std::string& name : case_names) {
+        if (!only_case.empty() && name != only_case) {
+            continue;
+        }
+        pid_t pid = fork();
+        if (pid == 0) {
+            // generate the corpus in the child, so that only this case counts towards its peak RSS
+            BenchmarkCase c = make_case(name, scale);
+            print_result(label, c, run_case(c, repeat));
+            std::_Exit(0);
+        }
+        int child_status = 0;
+        waitpid(pid, &child_status, 0);
+        if (!WIFEXITED(child_status) || WEXITSTATUS(child_status) != 0) {
+            std::cerr << "Case " << name << " failed" << std::endl;
+            status = 1;
+        }
+    }
+    return status;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * Deterministic generator of synthetic SGF documents for the benchmarks.
+ *
+ * Every document uses Connect6 style moves (`B[JJ]`, `W[IH]`, ...) on a 19x19 board. The same seed
+ * always produces the same corpus, so results can be compared between commits.
+ */
+class SGFCorpusGenerator {
+public:
+    explicit SGFCorpusGenerator(unsigned seed = 20120622) : rng(seed) {}
+
+    // One game of `num_nodes` moves without variations.
+    std::string deep_linear(size_t num_nodes)
+    {
+        std::string sgf = "(";
+        for (size_t i = 0; i < num_nodes; ++i) {
+            append_move(sgf, i);
+        }
+        sgf += ")";
+        return sgf;
+    }
+
+    // A root with `num_children` single-move variations.
+    std::string wide(size_t num_children)
+    {
+        std::string sgf = "(;B[JJ]";
+        for (size_t i = 0; i < num_children; ++i) {
+            sgf += "(";
+            append_move(sgf, i + 1);
+            sgf += ")";
+        }
+        sgf += ")";
+        return sgf;
+    }
+
+    // A game whose nodes all carry a comment of `comment_length` characters, including escaped brackets.
+    std::string comment_heavy(size_t num_nodes, size_t comment_length)
+    {
+        static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789 :,-";
+        std::uniform_int_distribution<size_t> letter(0, sizeof(alphabet) - 2);
+        std::string sgf = "(";
+        for (size_t i = 0; i < num_nodes; ++i) {
+            append_move(sgf, i);
+            sgf += "C[";
+            for (size_t j = 0; j < comment_length; ++j) {
+                if (j % 64 == 63) {
+                    sgf += "\\]";
+                } else {
+                    sgf += alphabet[letter(rng)];
+                }
+            }
+            sgf += "]";
+        }
+        sgf += ")";
+        return sgf;
+    }
+
+    // `num_documents` short games with one or two variations each.
+    std::vector<std::string> small_documents(size_t num_documents)
+    {
+        std::uniform_int_distribution<size_t> length(3, 12);
+        std::vector<std::string> documents;
+        documents.reserve(num_documents);
+        for (size_t i = 0; i < num_documents; ++i) {
+            std::string sgf = "(";
+            size_t n = length(rng);
+            for (size_t j = 0; j < n; ++j) {
+                append_move(sgf, j);
+            }
+            if (i % 2 == 0) {
+                sgf += "(";
+                append_move(sgf, n);
+                sgf += ")(";
+                append_move(sgf, n);
+                sgf += ")";
+            }
+            sgf += ")";
+            documents.push_back(std::move(sgf));
+        }
+        return documents;
+    }
+
+private:
+    // Black opens with one stone, then both players place two stones per turn.
+    void append_move(std::string& sgf, size_t index)
+    {
+        std::uniform_int_distribution<int> coordinate(0, 18);
+        bool white = index != 0 && ((index - 1) / 2) % 2 == 0;
+        sgf += white ? ";W[" : ";B[";
+        sgf += static_cast<char>('A' + coordinate(rng));
+        sgf += static_cast<char>('A' + coordinate(rng));
+        sgf += "]";
+    }
+
+    std::mt19937 rng;
+};
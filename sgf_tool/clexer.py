@@ -3,6 +3,11 @@ import typing
 from . import DynamicLibrary as dl
 import os
 
+try:
+    from . import cnative
+except (ImportError, OSError, RuntimeError):
+    cnative = None
+
 
 class SGFTokenType(enum.Enum):
     LEFT_PAREN = 0
@@ -97,15 +102,30 @@ API void print_token(SGFToken* token) {
 class SGFLexer:
     def __init__(self, sgf: str, start: int = 0, progress_callback: typing.Optional[typing.Callable[[int, int], None]] = None):
         self.length = len(sgf)
-        self.token = lib.create_token()
-        self.lexer = lib.create_lexer(sgf.encode(), start, 0)
         self.progress_callback = progress_callback
+        self.native = None
+        self.token = None
+        self.lexer = None
+        if cnative is not None:
+            # one call per token instead of six ctypes calls
+            self.native = cnative.Lexer(sgf, start)
+        else:
+            self.token = lib.create_token()
+            self.lexer = lib.create_lexer(sgf.encode(), start, 0)
 
     def __del__(self):
-        lib.delete_token(self.token)
-        lib.delete_lexer(self.lexer)
+        if self.token is not None:
+            lib.delete_token(self.token)
+        if self.lexer is not None:
+            lib.delete_lexer(self.lexer)
 
     def next_token(self):
+        if self.native is not None:
+            token_type, value, start, end = self.native.next_token()
+            if self.progress_callback:
+                self.progress_callback(end, self.length)
+            return SGFToken(SGFTokenType(token_type), value, start, end)
+
         lib.next_token(self.lexer, self.token)
         token_type = lib.get_token_type(self.token)
         value_length = lib.get_token_value_length(self.token)
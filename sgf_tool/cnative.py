@@ -0,0 +1,965 @@
+"""
+CPython extension over the C++ lexer and parser.
+
+`parse` returns a `FlatTree`, the whole parsed tree in flat arrays (see `flat_tree.hpp`) that are
+exposed through the buffer protocol without copying, e.g. `numpy.asarray(tree.parent)`. Python
+strings are only created for the nodes asked for, through `FlatTree.properties` or `FlatTree.build`.
+Traversals and property queries (`dfs`, `find`, ...) run in C++ and return node indices; `find`
+answers from the (tag, value) index of `property_index.hpp` once it is built, with `parse(sgf,
+index=True)` or `FlatTree.build_index`. `merge` combines trees sharing their root with the
+threaded k-way merge of `tree_merge.hpp`; `merge_files` does the same for SGF files larger than
+memory with the external merge of `external_merge.hpp`, writing the merged tree to a file.
+`FlatTree.share` hash-conses identical subtrees into a `TreeDAG` (see `tree_dag.hpp`), which
+`TreeDAG.expand` turns back into a `FlatTree`.
+`Lexer.next_token` returns a whole token per call.
+"""
+import os
+from . import DynamicLibrary as dl
+
+base_dir = os.path.dirname(os.path.abspath(__file__))
+native = dl.DynamicLibrary(extra_compile_flags=['-I' + base_dir]).compile_extension('sgf_tool._native', r'''
+#include "external_merge.hpp"
+#include "flat_tree.hpp"
+#include "lexer.hpp"
+#include "property_index.hpp"
+#include "tree_dag.hpp"
+#include "tree_merge.hpp"
+#include "tree_query.hpp"
+#include <cstring>
+#include <exception>
+#include <new>
+#include <stdexcept>
+
+/* ---------------- errors ---------------- */
+
+static PyObject* raise_sgf_exception(const BaseSGFException& e, const char* class_name)
+{
+    PyObject* module = PyImport_ImportModule("sgf_tool.exceptions");
+    if (module == nullptr) {
+        return nullptr;
+    }
+    PyObject* cls = PyObject_GetAttrString(module, class_name);
+    Py_DECREF(module);
+    if (cls == nullptr) {
+        return nullptr;
+    }
+    PyObject* exc = PyObject_CallFunction(cls, "sii", e.message.c_str(), e.start, e.end);
+    Py_DECREF(cls);
+    if (exc != nullptr) {
+        PyErr_SetObject(reinterpret_cast<PyObject*>(Py_TYPE(exc)), exc);
+        Py_DECREF(exc);
+    }
+    return nullptr;
+}
+
+// Raise the Python counterpart of a C++ exception thrown by the lexer or parser.
+static PyObject* set_error(std::exception_ptr error)
+{
+    try {
+        std::rethrow_exception(error);
+    } catch (const LexicalError& e) {
+        return raise_sgf_exception(e, "LexicalError");
+    } catch (const SGFError& e) {
+        return raise_sgf_exception(e, "SGFError");
+    } catch (const std::bad_alloc&) {
+        return PyErr_NoMemory();
+    } catch (const std::invalid_argument& e) {
+        PyErr_SetString(PyExc_ValueError, e.what());
+    } catch (const std::exception& e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+    } catch (...) {
+        PyErr_SetString(PyExc_RuntimeError, "unknown C++ exception");
+    }
+    return nullptr;
+}
+
+/* ---------------- ArrayView: read-only buffer over memory owned by another object ---------------- */
+
+struct ArrayViewObject {
+    PyObject_HEAD
+    PyObject* owner;
+    void* data;
+    Py_ssize_t length;
+    Py_ssize_t itemsize;
+    const char* format;
+};
+
+static void ArrayView_dealloc(ArrayViewObject* self)
+{
+    Py_XDECREF(self->owner);
+    Py_TYPE(self)->tp_free(reinterpret_cast<PyObject*>(self));
+}
+
+static int ArrayView_getbuffer(ArrayViewObject* self, Py_buffer* view, int flags)
+{
+    if (flags & PyBUF_WRITABLE) {
+        PyErr_SetString(PyExc_BufferError, "FlatTree buffers are read-only");
+        return -1;
+    }
+    static char empty = 0;
+    view->buf = self->data != nullptr ? self->data : &empty;
+    view->obj = reinterpret_cast<PyObject*>(self);
+    Py_INCREF(self);
+    view->len = self->length * self->itemsize;
+    view->readonly = 1;
+    view->itemsize = self->itemsize;
+    view->format = (flags & PyBUF_FORMAT) ? const_cast<char*>(self->format) : nullptr;
+    view->ndim = 1;
+    view->shape = (flags & PyBUF_ND) ? &self->length : nullptr;
+    view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? &self->itemsize : nullptr;
+    view->suboffsets = nullptr;
+    view->internal = nullptr;
+    return 0;
+}
+
+static PyBufferProcs ArrayView_as_buffer = {
+    reinterpret_cast<getbufferproc>(ArrayView_getbuffer),
+    nullptr,
+};
+
+static PyTypeObject ArrayViewType = {
+    PyVarObject_HEAD_INIT(nullptr, 0)
+};
+
+// A memoryview of `length` items of `data`, keeping `owner` alive.
+static PyObject* make_view(PyObject* owner, const void* data, size_t length, size_t itemsize, const char* format)
+{
+    ArrayViewObject* array = PyObject_New(ArrayViewObject, &ArrayViewType);
+    if (array == nullptr) {
+        return nullptr;
+    }
+    Py_INCREF(owner);
+    array->owner = owner;
+    array->data = const_cast<void*>(data);
+    array->length = static_cast<Py_ssize_t>(length);
+    array->itemsize = static_cast<Py_ssize_t>(itemsize);
+    array->format = format;
+    PyObject* view = PyMemoryView_FromObject(reinterpret_cast<PyObject*>(array));
+    Py_DECREF(array);
+    return view;
+}
+
+static void delete_int64_vector(PyObject* capsule)
+{
+    delete static_cast<std::vector<int64_t>*>(PyCapsule_GetPointer(capsule, "int64_vector"));
+}
+
+// A memoryview owning `array`.
+static PyObject* make_owned_view(std::vector<int64_t>&& array)
+{
+    auto* owned = new std::vector<int64_t>(std::move(array));
+    PyObject* capsule = PyCapsule_New(owned, "int64_vector", delete_int64_vector);
+    if (capsule == nullptr) {
+        delete owned;
+        return nullptr;
+    }
+    PyObject* view = make_view(capsule, owned->data(), owned->size(), sizeof(int64_t), "q");
+    Py_DECREF(capsule);
+    return view;
+}
+
+/* ---------------- FlatTree ---------------- */
+
+struct FlatTreeObject {
+    PyObject_HEAD
+    SGFFlatTree* tree;
+    SGFPropertyIndex* index; // nullptr until built
+};
+
+static PyTypeObject FlatTreeType = {
+    PyVarObject_HEAD_INIT(nullptr, 0)
+};
+
+static void FlatTree_dealloc(FlatTreeObject* self)
+{
+    delete self->index;
+    delete self->tree;
+    Py_TYPE(self)->tp_free(reinterpret_cast<PyObject*>(self));
+}
+
+static Py_ssize_t FlatTree_length(FlatTreeObject* self)
+{
+    return static_cast<Py_ssize_t>(self->tree->num_nodes());
+}
+
+template <typename Tree>
+static PyObject* decode_item(const Tree& tree, size_t item)
+{
+    return PyUnicode_DecodeUTF8(tree.item_data(item), tree.item_size(item), "strict");
+}
+
+template <typename Tree>
+static bool check_index(const Tree& tree, Py_ssize_t index)
+{
+    if (index < 0 || static_cast<size_t>(index) >= tree.num_nodes()) {
+        PyErr_SetString(PyExc_IndexError, "node index out of range");
+        return false;
+    }
+    return true;
+}
+
+// {tag: [values]} of one node, in the order of the SGF source.
+template <typename Tree>
+static PyObject* node_properties(const Tree& tree, size_t index)
+{
+    PyObject* properties = PyDict_New();
+    if (properties == nullptr) {
+        return nullptr;
+    }
+    PyObject* values = nullptr; // borrowed from `properties`
+    for (int64_t item = tree.node_items[index]; item < tree.node_items[index + 1]; ++item) {
+        PyObject* text = decode_item(tree, item);
+        if (text == nullptr) {
+            Py_DECREF(properties);
+            return nullptr;
+        }
+        int status;
+        if (tree.is_tag[item]) {
+            values = PyList_New(0);
+            status = values != nullptr ? PyDict_SetItem(properties, text, values) : -1;
+            Py_XDECREF(values);
+        } else {
+            status = PyList_Append(values, text);
+        }
+        Py_DECREF(text);
+        if (status < 0) {
+            Py_DECREF(properties);
+            return nullptr;
+        }
+    }
+    return properties;
+}
+
+static PyObject* FlatTree_properties(FlatTreeObject* self, PyObject* arg)
+{
+    Py_ssize_t index = PyLong_AsSsize_t(arg);
+    if (index == -1 && PyErr_Occurred()) {
+        return nullptr;
+    }
+    if (!check_index(*self->tree, index)) {
+        return nullptr;
+    }
+    return node_properties(*self->tree, index);
+}
+
+/**
+ * Create one node per flat node with `allocate()`, fill it with `node[tag] = values` and link it
+ * with `parent.add_child(node)`. Returns the root, or None for an empty tree.
+ */
+static PyObject* FlatTree_build(FlatTreeObject* self, PyObject* allocate)
+{
+    const SGFFlatTree& tree = *self->tree;
+    size_t num_nodes = tree.num_nodes();
+    if (num_nodes == 0) {
+        Py_RETURN_NONE;
+    }
+    static PyObject* add_child = PyUnicode_InternFromString("add_child");
+    std::vector<PyObject*> nodes;
+    nodes.reserve(num_nodes);
+    auto fail = [&]() -> PyObject* {
+        for (PyObject* node : nodes) {
+            Py_DECREF(node);
+        }
+        return nullptr;
+    };
+
+    for (size_t i = 0; i < num_nodes; ++i) {
+        PyObject* node = PyObject_CallNoArgs(allocate);
+        if (node == nullptr) {
+            return fail();
+        }
+        nodes.push_back(node);
+        PyObject* properties = node_properties(tree, i);
+        if (properties == nullptr) {
+            return fail();
+        }
+        PyObject* tag;
+        PyObject* values;
+        Py_ssize_t position = 0;
+        while (PyDict_Next(properties, &position, &tag, &values)) {
+            if (PyObject_SetItem(node, tag, values) < 0) {
+                Py_DECREF(properties);
+                return fail();
+            }
+        }
+        Py_DECREF(properties);
+        if (tree.parent[i] >= 0) {
+            PyObject* result = PyObject_CallMethodOneArg(nodes[tree.parent[i]], add_child, node);
+            if (result == nullptr) {
+                return fail();
+            }
+            Py_DECREF(result);
+        }
+    }
+    PyObject* root = nodes[0];
+    Py_INCREF(root);
+    fail();
+    return root;
+}
+
+using Traversal = void (*)(const SGFFlatTree&, size_t, std::vector<int64_t>&, std::vector<int64_t>&);
+
+// traversal(root=0) -> (indices, depths)
+template <Traversal traversal>
+static PyObject* FlatTree_traverse(FlatTreeObject* self, PyObject* args, PyObject* kwargs)
+{
+    static const char* keywords[] = {"root", nullptr};
+    Py_ssize_t root = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|n", const_cast<char**>(keywords), &root)) {
+        return nullptr;
+    }
+    if (!check_index(*self->tree, root)) {
+        return nullptr;
+    }
+    std::vector<int64_t> order;
+    std::vector<int64_t> depths;
+    std::exception_ptr error;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        traversal(*self->tree, root, order, depths);
+    } catch (...) {
+        error = std::current_exception();
+    }
+    Py_END_ALLOW_THREADS
+    if (error) {
+        return set_error(error);
+    }
+    PyObject* order_view = make_owned_view(std::move(order));
+    PyObject* depths_view = order_view != nullptr ? make_owned_view(std::move(depths)) : nullptr;
+    if (depths_view == nullptr) {
+        Py_XDECREF(order_view);
+        return nullptr;
+    }
+    return Py_BuildValue("(NN)", order_view, depths_view);
+}
+
+static PyObject* FlatTree_find(FlatTreeObject* self, PyObject* args, PyObject* kwargs)
+{
+    static const char* keywords[] = {"tag", "value", "value_index", "root", nullptr};
+    const char* tag;
+    Py_ssize_t tag_length;
+    const char* value = nullptr;
+    Py_ssize_t value_length = 0;
+    PyObject* value_index_object = nullptr;
+    Py_ssize_t root = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s#|z#On", const_cast<char**>(keywords),
+                                     &tag, &tag_length, &value, &value_length, &value_index_object, &root)) {
+        return nullptr;
+    }
+    // None matches any index
+    Py_ssize_t value_index = 0;
+    if (value_index_object != nullptr && value_index_object != Py_None) {
+        value_index = PyLong_AsSsize_t(value_index_object);
+        if (value_index == -1 && PyErr_Occurred()) {
+            return nullptr;
+        }
+    }
+    if (!check_index(*self->tree, root)) {
+        return nullptr;
+    }
+    SGFTreeQuery::Predicate predicate;
+    predicate.tag.assign(tag, tag_length);
+    predicate.match_value = value != nullptr;
+    if (value != nullptr) {
+        predicate.value.assign(value, value_length);
+    }
+    predicate.value_index = value_index;
+    predicate.any_index = value_index_object == Py_None;
+    std::vector<int64_t> result;
+    std::exception_ptr error;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        if (self->index != nullptr) {
+            result = self->index->lookup(*self->tree, predicate, root, SGFTreeQuery::subtree_end(*self->tree, root));
+        } else {
+            result = SGFTreeQuery::find(*self->tree, root, predicate);
+        }
+    } catch (...) {
+        error = std::current_exception();
+    }
+    Py_END_ALLOW_THREADS
+    if (error) {
+        return set_error(error);
+    }
+    return make_owned_view(std::move(result));
+}
+
+static PyObject* FlatTree_build_index(FlatTreeObject* self, PyObject*)
+{
+    if (self->index == nullptr) {
+        SGFPropertyIndex* index = nullptr;
+        std::exception_ptr error;
+        Py_BEGIN_ALLOW_THREADS
+        try {
+            index = new SGFPropertyIndex(*self->tree);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        Py_END_ALLOW_THREADS
+        if (error) {
+            return set_error(error);
+        }
+        self->index = index;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject* FlatTree_get_index_bytes(FlatTreeObject* self, void*)
+{
+    if (self->index == nullptr) {
+        Py_RETURN_NONE;
+    }
+    return PyLong_FromSize_t(self->index->posting_bytes());
+}
+
+static PyObject* FlatTree_get_content(FlatTreeObject* self, void*)
+{
+    return make_view(reinterpret_cast<PyObject*>(self), self->tree->content.data(), self->tree->content.size(), 1, "B");
+}
+
+static PyObject* FlatTree_get_is_tag(FlatTreeObject* self, void*)
+{
+    return make_view(reinterpret_cast<PyObject*>(self), self->tree->is_tag.data(), self->tree->is_tag.size(), 1, "B");
+}
+
+template <std::vector<int64_t> SGFFlatTree::*member>
+static PyObject* FlatTree_get_int64(FlatTreeObject* self, void*)
+{
+    const std::vector<int64_t>& array = self->tree->*member;
+    return make_view(reinterpret_cast<PyObject*>(self), array.data(), array.size(), sizeof(int64_t), "q");
+}
+
+static PyObject* FlatTree_share(FlatTreeObject* self, PyObject*);
+
+static PyMethodDef FlatTree_methods[] = {
+    {"properties", reinterpret_cast<PyCFunction>(FlatTree_properties), METH_O, "properties(index) -> {tag: [values]} of one node"},
+    {"build", reinterpret_cast<PyCFunction>(FlatTree_build), METH_O, "build(allocate) -> root node built from every flat node"},
+    {"dfs", reinterpret_cast<PyCFunction>(FlatTree_traverse<SGFTreeQuery::dfs>), METH_VARARGS | METH_KEYWORDS, "dfs(root=0) -> (indices, depths) in pre-order"},
+    {"bfs", reinterpret_cast<PyCFunction>(FlatTree_traverse<SGFTreeQuery::bfs>), METH_VARARGS | METH_KEYWORDS, "bfs(root=0) -> (indices, depths) level by level"},
+    {"bottom_up_dfs", reinterpret_cast<PyCFunction>(FlatTree_traverse<SGFTreeQuery::bottom_up_dfs>), METH_VARARGS | METH_KEYWORDS, "bottom_up_dfs(root=0) -> (indices, depths) in post-order"},
+    {"bottom_up_bfs", reinterpret_cast<PyCFunction>(FlatTree_traverse<SGFTreeQuery::bottom_up_bfs>), METH_VARARGS | METH_KEYWORDS, "bottom_up_bfs(root=0) -> (indices, depths), deepest level first"},
+    {"find", reinterpret_cast<PyCFunction>(FlatTree_find), METH_VARARGS | METH_KEYWORDS,
+     "find(tag, value=None, value_index=0, root=0) -> indices of the nodes in the subtree of root having tag, "
+     "with value at value_index (any index if None) unless value is None; uses the property index once built"},
+    {"build_index", reinterpret_cast<PyCFunction>(FlatTree_build_index), METH_NOARGS, "build_index() -> None, build the (tag, value) index used by find"},
+    {"share", reinterpret_cast<PyCFunction>(FlatTree_share), METH_NOARGS, "share() -> TreeDAG storing identical subtrees once"},
+    {nullptr, nullptr, 0, nullptr},
+};
+
+static PyGetSetDef FlatTree_getset[] = {
+    {"content", reinterpret_cast<getter>(FlatTree_get_content), nullptr, "tags and values in pre-order, as bytes", nullptr},
+    {"item_offsets", reinterpret_cast<getter>(FlatTree_get_int64<&SGFFlatTree::item_offsets>), nullptr, "offsets of the items in content", nullptr},
+    {"is_tag", reinterpret_cast<getter>(FlatTree_get_is_tag), nullptr, "1 for tags, 0 for values", nullptr},
+    {"node_items", reinterpret_cast<getter>(FlatTree_get_int64<&SGFFlatTree::node_items>), nullptr, "first item of each node", nullptr},
+    {"parent", reinterpret_cast<getter>(FlatTree_get_int64<&SGFFlatTree::parent>), nullptr, "parent of each node, -1 for the root", nullptr},
+    {"first_child", reinterpret_cast<getter>(FlatTree_get_int64<&SGFFlatTree::first_child>), nullptr, "first child of each node or -1", nullptr},
+    {"next_sibling", reinterpret_cast<getter>(FlatTree_get_int64<&SGFFlatTree::next_sibling>), nullptr, "next sibling of each node or -1", nullptr},
+    {"index_bytes", reinterpret_cast<getter>(FlatTree_get_index_bytes), nullptr, "size of the encoded posting lists, None without an index", nullptr},
+    {nullptr, nullptr, nullptr, nullptr, nullptr},
+};
+
+static PySequenceMethods FlatTree_as_sequence = {
+    reinterpret_cast<lenfunc>(FlatTree_length),
+};
+
+/* ---------------- TreeDAG ---------------- */
+
+struct TreeDAGObject {
+    PyObject_HEAD
+    SGFTreeDAG* dag;
+};
+
+static PyTypeObject TreeDAGType = {
+    PyVarObject_HEAD_INIT(nullptr, 0)
+};
+
+static void TreeDAG_dealloc(TreeDAGObject* self)
+{
+    delete self->dag;
+    Py_TYPE(self)->tp_free(reinterpret_cast<PyObject*>(self));
+}
+
+static Py_ssize_t TreeDAG_length(TreeDAGObject* self)
+{
+    return static_cast<Py_ssize_t>(self->dag->num_nodes());
+}
+
+static PyObject* FlatTree_share(FlatTreeObject* self, PyObject*)
+{
+    SGFTreeDAG* dag = nullptr;
+    std::exception_ptr error;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        dag = new SGFTreeDAG(SGFTreeDAG::share(*self->tree));
+    } catch (...) {
+        error = std::current_exception();
+    }
+    Py_END_ALLOW_THREADS
+    if (error) {
+        return set_error(error);
+    }
+    TreeDAGObject* result = PyObject_New(TreeDAGObject, &TreeDAGType);
+    if (result == nullptr) {
+        delete dag;
+        return nullptr;
+    }
+    result->dag = dag;
+    return reinterpret_cast<PyObject*>(result);
+}
+
+static PyObject* TreeDAG_properties(TreeDAGObject* self, PyObject* arg)
+{
+    Py_ssize_t index = PyLong_AsSsize_t(arg);
+    if (index == -1 && PyErr_Occurred()) {
+        return nullptr;
+    }
+    if (!check_index(*self->dag, index)) {
+        return nullptr;
+    }
+    return node_properties(*self->dag, index);
+}
+
+static PyObject* TreeDAG_children(TreeDAGObject* self, PyObject* arg)
+{
+    Py_ssize_t index = PyLong_AsSsize_t(arg);
+    if (index == -1 && PyErr_Occurred()) {
+        return nullptr;
+    }
+    if (!check_index(*self->dag, index)) {
+        return nullptr;
+    }
+    const SGFTreeDAG& dag = *self->dag;
+    int64_t first = dag.child_offsets[index];
+    return make_view(reinterpret_cast<PyObject*>(self), dag.children.data() + first, dag.child_offsets[index + 1] - first,
+                     sizeof(int64_t), "q");
+}
+
+static PyObject* TreeDAG_expand(TreeDAGObject* self, PyObject*)
+{
+    SGFFlatTree* tree = nullptr;
+    std::exception_ptr error;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        tree = new SGFFlatTree(self->dag->expand());
+    } catch (...) {
+        error = std::current_exception();
+    }
+    Py_END_ALLOW_THREADS
+    if (error) {
+        return set_error(error);
+    }
+    FlatTreeObject* result = PyObject_New(FlatTreeObject, &FlatTreeType);
+    if (result == nullptr) {
+        delete tree;
+        return nullptr;
+    }
+    result->tree = tree;
+    result->index = nullptr;
+    return reinterpret_cast<PyObject*>(result);
+}
+
+static PyObject* TreeDAG_get_root(TreeDAGObject* self, void*)
+{
+    return PyLong_FromLongLong(self->dag->root());
+}
+
+static PyObject* TreeDAG_get_num_tree_nodes(TreeDAGObject* self, void*)
+{
+    return PyLong_FromSize_t(self->dag->num_tree_nodes());
+}
+
+static PyObject* TreeDAG_get_content(TreeDAGObject* self, void*)
+{
+    return make_view(reinterpret_cast<PyObject*>(self), self->dag->content.data(), self->dag->content.size(), 1, "B");
+}
+
+static PyObject* TreeDAG_get_is_tag(TreeDAGObject* self, void*)
+{
+    return make_view(reinterpret_cast<PyObject*>(self), self->dag->is_tag.data(), self->dag->is_tag.size(), 1, "B");
+}
+
+template <std::vector<int64_t> SGFTreeDAG::*member>
+static PyObject* TreeDAG_get_int64(TreeDAGObject* self, void*)
+{
+    const std::vector<int64_t>& array = self->dag->*member;
+    return make_view(reinterpret_cast<PyObject*>(self), array.data(), array.size(), sizeof(int64_t), "q");
+}
+
+static PyMethodDef TreeDAG_methods[] = {
+    {"properties", reinterpret_cast<PyCFunction>(TreeDAG_properties), METH_O, "properties(index) -> {tag: [values]} of one node"},
+    {"children", reinterpret_cast<PyCFunction>(TreeDAG_children), METH_O, "children(index) -> indices of the children of one node"},
+    {"expand", reinterpret_cast<PyCFunction>(TreeDAG_expand), METH_NOARGS, "expand() -> FlatTree, the plain tree"},
+    {nullptr, nullptr, 0, nullptr},
+};
+
+static PyGetSetDef TreeDAG_getset[] = {
+    {"root", reinterpret_cast<getter>(TreeDAG_get_root), nullptr, "index of the root, the last node, -1 if empty", nullptr},
+    {"num_tree_nodes", reinterpret_cast<getter>(TreeDAG_get_num_tree_nodes), nullptr, "number of nodes of the plain tree", nullptr},
+    {"content", reinterpret_cast<getter>(TreeDAG_get_content), nullptr, "tags and values of the distinct nodes, as bytes", nullptr},
+    {"item_offsets", reinterpret_cast<getter>(TreeDAG_get_int64<&SGFTreeDAG::item_offsets>), nullptr, "offsets of the items in content", nullptr},
+    {"is_tag", reinterpret_cast<getter>(TreeDAG_get_is_tag), nullptr, "1 for tags, 0 for values", nullptr},
+    {"node_items", reinterpret_cast<getter>(TreeDAG_get_int64<&SGFTreeDAG::node_items>), nullptr, "first item of each node", nullptr},
+    {"child_offsets", reinterpret_cast<getter>(TreeDAG_get_int64<&SGFTreeDAG::child_offsets>), nullptr, "first entry of each node in children", nullptr},
+    {"children_array", reinterpret_cast<getter>(TreeDAG_get_int64<&SGFTreeDAG::children>), nullptr, "children of every node, shared nodes listed once per parent", nullptr},
+    {"tree_sizes", reinterpret_cast<getter>(TreeDAG_get_int64<&SGFTreeDAG::tree_sizes>), nullptr, "nodes of the plain subtree of each node", nullptr},
+    {nullptr, nullptr, nullptr, nullptr, nullptr},
+};
+
+static PySequenceMethods TreeDAG_as_sequence = {
+    reinterpret_cast<lenfunc>(TreeDAG_length),
+};
+
+/* ---------------- Lexer ---------------- */
+
+struct LexerObject {
+    PyObject_HEAD
+    SGFLexer* lexer;
+};
+
+static PyTypeObject LexerType = {
+    PyVarObject_HEAD_INIT(nullptr, 0)
+};
+
+static int Lexer_init(LexerObject* self, PyObject* args, PyObject* kwargs)
+{
+    static const char* keywords[] = {"sgf", "start", nullptr};
+    const char* sgf;
+    Py_ssize_t length;
+    Py_ssize_t start = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s#|n", const_cast<char**>(keywords), &sgf, &length, &start)) {
+        return -1;
+    }
+    delete self->lexer;
+    self->lexer = new SGFLexer(std::string(sgf, length), start);
+    return 0;
+}
+
+static void Lexer_dealloc(LexerObject* self)
+{
+    delete self->lexer;
+    Py_TYPE(self)->tp_free(reinterpret_cast<PyObject*>(self));
+}
+
+static PyObject* Lexer_next_token(LexerObject* self, PyObject*)
+{
+    if (self->lexer == nullptr) {
+        PyErr_SetString(PyExc_RuntimeError, "Lexer is not initialized");
+        return nullptr;
+    }
+    try {
+        const SGFToken& token = self->lexer->next_token();
+        return Py_BuildValue("(is#nn)", static_cast<int>(token.type), token.value.data(), static_cast<Py_ssize_t>(token.value.size()),
+                             static_cast<Py_ssize_t>(token.start), static_cast<Py_ssize_t>(token.end));
+    } catch (...) {
+        return set_error(std::current_exception());
+    }
+}
+
+static PyMethodDef Lexer_methods[] = {
+    {"next_token", reinterpret_cast<PyCFunction>(Lexer_next_token), METH_NOARGS, "next_token() -> (type, value, start, end)"},
+    {nullptr, nullptr, 0, nullptr},
+};
+
+/* ---------------- module ---------------- */
+
+static PyObject* native_parse(PyObject*, PyObject* args, PyObject* kwargs)
+{
+    static const char* keywords[] = {"sgf", "start", "index", nullptr};
+    const char* sgf;
+    Py_ssize_t length;
+    Py_ssize_t start = 0;
+    int build_index = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s#|np", const_cast<char**>(keywords), &sgf, &length, &start, &build_index)) {
+        return nullptr;
+    }
+
+    SGFFlatTree* tree = nullptr;
+    SGFPropertyIndex* index = nullptr;
+    std::exception_ptr error;
+    std::string source(sgf, length);
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        tree = new SGFFlatTree(SGFFlatTree::parse(std::move(source), start));
+        if (build_index) {
+            index = new SGFPropertyIndex(*tree);
+        }
+    } catch (...) {
+        delete tree;
+        error = std::current_exception();
+    }
+    Py_END_ALLOW_THREADS
+    if (error) {
+        return set_error(error);
+    }
+
+    FlatTreeObject* self = PyObject_New(FlatTreeObject, &FlatTreeType);
+    if (self == nullptr) {
+        delete index;
+        delete tree;
+        return nullptr;
+    }
+    self->tree = tree;
+    self->index = index;
+    return reinterpret_cast<PyObject*>(self);
+}
+
+static bool parse_merge_rule(PyObject* name, SGFMergeRule& rule)
+{
+    static const std::pair<const char*, SGFMergeRule> names[] = {
+        {"first", SGFMergeRule::FIRST}, {"last", SGFMergeRule::LAST}, {"sum", SGFMergeRule::SUM},
+        {"max", SGFMergeRule::MAX}, {"min", SGFMergeRule::MIN}, {"union", SGFMergeRule::UNION},
+    };
+    const char* text = PyUnicode_AsUTF8(name);
+    if (text == nullptr) {
+        return false;
+    }
+    for (const auto& [rule_name, value] : names) {
+        if (std::strcmp(text, rule_name) == 0) {
+            rule = value;
+            return true;
+        }
+    }
+    PyErr_Format(PyExc_ValueError, "unknown merge rule '%s'", text);
+    return false;
+}
+
+// Fill `policy` from a dict of tag to rule name.
+static bool parse_merge_rules(PyObject* rules_arg, SGFMergePolicy& policy)
+{
+    if (rules_arg == nullptr || rules_arg == Py_None) {
+        return true;
+    }
+    if (!PyDict_Check(rules_arg)) {
+        PyErr_SetString(PyExc_TypeError, "rules must be a dict of tag to rule name");
+        return false;
+    }
+    PyObject* tag;
+    PyObject* name;
+    Py_ssize_t position = 0;
+    while (PyDict_Next(rules_arg, &position, &tag, &name)) {
+        SGFMergeRule rule;
+        const char* tag_text = PyUnicode_AsUTF8(tag);
+        if (tag_text == nullptr || !parse_merge_rule(name, rule)) {
+            return false;
+        }
+        policy.set_rule(tag_text, rule);
+    }
+    return true;
+}
+
+static bool parse_strings(PyObject* sequence_arg, const char* message, std::vector<std::string>& strings)
+{
+    PyObject* sequence = PySequence_Fast(sequence_arg, message);
+    if (sequence == nullptr) {
+        return false;
+    }
+    strings.clear();
+    for (Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(sequence); ++i) {
+        PyObject* item = PySequence_Fast_GET_ITEM(sequence, i);
+        // str, bytes or a path
+        PyObject* bytes = nullptr;
+        if (!PyUnicode_FSConverter(item, &bytes)) {
+            Py_DECREF(sequence);
+            return false;
+        }
+        strings.emplace_back(PyBytes_AS_STRING(bytes));
+        Py_DECREF(bytes);
+    }
+    Py_DECREF(sequence);
+    return true;
+}
+
+static PyObject* native_merge(PyObject*, PyObject* args, PyObject* kwargs)
+{
+    static const char* keywords[] = {"trees", "key_tags", "rules", "default_rule", "threads", nullptr};
+    PyObject* trees_arg;
+    PyObject* key_tags_arg = nullptr;
+    PyObject* rules_arg = nullptr;
+    PyObject* default_rule_arg = nullptr;
+    Py_ssize_t threads = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|OOOn", const_cast<char**>(keywords),
+                                     &trees_arg, &key_tags_arg, &rules_arg, &default_rule_arg, &threads)) {
+        return nullptr;
+    }
+
+    SGFMergeRule default_rule = SGFMergeRule::FIRST;
+    if (default_rule_arg != nullptr && !parse_merge_rule(default_rule_arg, default_rule)) {
+        return nullptr;
+    }
+    SGFMergePolicy policy(default_rule);
+    if (!parse_merge_rules(rules_arg, policy)) {
+        return nullptr;
+    }
+    std::vector<std::string> key_tags{"B", "W"};
+    if (key_tags_arg != nullptr && key_tags_arg != Py_None &&
+        !parse_strings(key_tags_arg, "key_tags must be a sequence of tags", key_tags)) {
+        return nullptr;
+    }
+
+    // the sequence keeps the trees alive while the GIL is released
+    PyObject* sequence = PySequence_Fast(trees_arg, "trees must be a sequence of FlatTree");
+    if (sequence == nullptr) {
+        return nullptr;
+    }
+    std::vector<const SGFFlatTree*> trees;
+    for (Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(sequence); ++i) {
+        PyObject* item = PySequence_Fast_GET_ITEM(sequence, i);
+        if (!PyObject_TypeCheck(item, &FlatTreeType)) {
+            Py_DECREF(sequence);
+            PyErr_SetString(PyExc_TypeError, "trees must be a sequence of FlatTree");
+            return nullptr;
+        }
+        trees.push_back(reinterpret_cast<FlatTreeObject*>(item)->tree);
+    }
+
+    SGFFlatTree* tree = nullptr;
+    std::exception_ptr error;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        tree = new SGFFlatTree(SGFTreeMerger(std::move(key_tags), policy, threads).merge(trees));
+    } catch (...) {
+        error = std::current_exception();
+    }
+    Py_END_ALLOW_THREADS
+    Py_DECREF(sequence);
+    if (error) {
+        return set_error(error);
+    }
+
+    FlatTreeObject* self = PyObject_New(FlatTreeObject, &FlatTreeType);
+    if (self == nullptr) {
+        delete tree;
+        return nullptr;
+    }
+    self->tree = tree;
+    self->index = nullptr;
+    return reinterpret_cast<PyObject*>(self);
+}
+
+static PyObject* native_merge_files(PyObject*, PyObject* args, PyObject* kwargs)
+{
+    static const char* keywords[] = {"inputs", "output", "key_tags", "rules", "default_rule", "memory_budget",
+                                     "spill_directory", "presorted", nullptr};
+    PyObject* inputs_arg;
+    PyObject* output_arg;
+    PyObject* key_tags_arg = nullptr;
+    PyObject* rules_arg = nullptr;
+    PyObject* default_rule_arg = nullptr;
+    Py_ssize_t memory_budget = 0;
+    PyObject* spill_directory_arg = nullptr;
+    int presorted = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO&|OOOnO&p", const_cast<char**>(keywords),
+                                     &inputs_arg, PyUnicode_FSConverter, &output_arg, &key_tags_arg, &rules_arg,
+                                     &default_rule_arg, &memory_budget, PyUnicode_FSConverter, &spill_directory_arg,
+                                     &presorted)) {
+        return nullptr;
+    }
+    SGFExternalMerger::Options options;
+    options.presorted = presorted != 0;
+    if (memory_budget > 0) {
+        options.memory_budget = static_cast<size_t>(memory_budget);
+    }
+    std::string output = PyBytes_AS_STRING(output_arg);
+    Py_DECREF(output_arg);
+    if (spill_directory_arg != nullptr) {
+        options.spill_directory = PyBytes_AS_STRING(spill_directory_arg);
+        Py_DECREF(spill_directory_arg);
+    }
+
+    SGFMergeRule default_rule = SGFMergeRule::FIRST;
+    if (default_rule_arg != nullptr && !parse_merge_rule(default_rule_arg, default_rule)) {
+        return nullptr;
+    }
+    SGFMergePolicy policy(default_rule);
+    std::vector<std::string> inputs;
+    if (!parse_merge_rules(rules_arg, policy) ||
+        !parse_strings(inputs_arg, "inputs must be a sequence of paths", inputs) ||
+        (key_tags_arg != nullptr && key_tags_arg != Py_None &&
+         !parse_strings(key_tags_arg, "key_tags must be a sequence of tags", options.key_tags))) {
+        return nullptr;
+    }
+
+    SGFExternalMerger::Statistics statistics;
+    std::exception_ptr error;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        statistics = SGFExternalMerger(std::move(options), policy).merge(inputs, output);
+    } catch (...) {
+        error = std::current_exception();
+    }
+    Py_END_ALLOW_THREADS
+    if (error) {
+        return set_error(error);
+    }
+    return Py_BuildValue("{s:n,s:n,s:n,s:n}", "nodes_read", static_cast<Py_ssize_t>(statistics.nodes_read),
+                         "nodes_written", static_cast<Py_ssize_t>(statistics.nodes_written),
+                         "runs_spilled", static_cast<Py_ssize_t>(statistics.runs_spilled),
+                         "bytes_spilled", static_cast<Py_ssize_t>(statistics.bytes_spilled));
+}
+
+static PyMethodDef native_methods[] = {
+    {"parse", reinterpret_cast<PyCFunction>(native_parse), METH_VARARGS | METH_KEYWORDS, "parse(sgf, start=0, index=False) -> FlatTree, with its property index if index is set"},
+    {"merge", reinterpret_cast<PyCFunction>(native_merge), METH_VARARGS | METH_KEYWORDS,
+     "merge(trees, key_tags=('B', 'W'), rules=None, default_rule='first', threads=0) -> FlatTree merging trees that share their root; "
+     "children are matched by the values of key_tags, siblings of one tree included, and matched properties combined by rules ({tag: 'first'|'last'|'sum'|'max'|'min'|'union'})"},
+    {"merge_files", reinterpret_cast<PyCFunction>(native_merge_files), METH_VARARGS | METH_KEYWORDS,
+     "merge_files(inputs, output, key_tags=('B', 'W'), rules=None, default_rule='first', memory_budget=0, spill_directory='/tmp', presorted=False) -> dict "
+     "of statistics; merges SGF files into output in bounded memory, like merge but with children sorted by key"},
+    {nullptr, nullptr, 0, nullptr},
+};
+
+static PyModuleDef native_module = {
+    PyModuleDef_HEAD_INIT, "_native", "Native SGF lexer and parser", -1, native_methods,
+};
+
+static bool ready(PyTypeObject* type, const char* name, Py_ssize_t size)
+{
+    type->tp_name = name;
+    type->tp_basicsize = size;
+    type->tp_flags = Py_TPFLAGS_DEFAULT;
+    return PyType_Ready(type) == 0;
+}
+
+PyMODINIT_FUNC PyInit__native(void)
+{
+    ArrayViewType.tp_dealloc = reinterpret_cast<destructor>(ArrayView_dealloc);
+    ArrayViewType.tp_as_buffer = &ArrayView_as_buffer;
+    FlatTreeType.tp_dealloc = reinterpret_cast<destructor>(FlatTree_dealloc);
+    FlatTreeType.tp_methods = FlatTree_methods;
+    FlatTreeType.tp_getset = FlatTree_getset;
+    FlatTreeType.tp_as_sequence = &FlatTree_as_sequence;
+    TreeDAGType.tp_dealloc = reinterpret_cast<destructor>(TreeDAG_dealloc);
+    TreeDAGType.tp_methods = TreeDAG_methods;
+    TreeDAGType.tp_getset = TreeDAG_getset;
+    TreeDAGType.tp_as_sequence = &TreeDAG_as_sequence;
+    LexerType.tp_new = PyType_GenericNew;
+    LexerType.tp_init = reinterpret_cast<initproc>(Lexer_init);
+    LexerType.tp_dealloc = reinterpret_cast<destructor>(Lexer_dealloc);
+    LexerType.tp_methods = Lexer_methods;
+    if (!ready(&ArrayViewType, "sgf_tool._native.ArrayView", sizeof(ArrayViewObject)) ||
+        !ready(&FlatTreeType, "sgf_tool._native.FlatTree", sizeof(FlatTreeObject)) ||
+        !ready(&TreeDAGType, "sgf_tool._native.TreeDAG", sizeof(TreeDAGObject)) ||
+        !ready(&LexerType, "sgf_tool._native.Lexer", sizeof(LexerObject))) {
+        return nullptr;
+    }
+
+    PyObject* module = PyModule_Create(&native_module);
+    if (module == nullptr) {
+        return nullptr;
+    }
+    if (PyModule_AddObjectRef(module, "FlatTree", reinterpret_cast<PyObject*>(&FlatTreeType)) < 0 ||
+        PyModule_AddObjectRef(module, "TreeDAG", reinterpret_cast<PyObject*>(&TreeDAGType)) < 0 ||
+        PyModule_AddObjectRef(module, "Lexer", reinterpret_cast<PyObject*>(&LexerType)) < 0) {
+        Py_DECREF(module);
+        return nullptr;
+    }
+    return module;
+}
+''')
+
+FlatTree = native.FlatTree
+TreeDAG = native.TreeDAG
+Lexer = native.Lexer
+parse = native.parse
+merge = native.merge
+merge_files = native.merge_files
@@ -4,6 +4,7 @@ from .exceptions import SGFError
 from . import DynamicLibrary as dl
 from .utils import Timer, DummyTimer, TrackingTimer
 from .parser import T, NodeAllocator, DefaultNodeAllocator
+from .lazy_node import LazySGFNode, LazySGFTree
 import numpy as np
 import itertools
 import os
@@ -11,13 +12,19 @@ import sys
 import typing
 import threading
 
+try:
+    from . import cnative
+except (ImportError, OSError, RuntimeError):  # e.g. no Python headers, parse through ctypes
+    cnative = None
 
 base_dir = os.path.dirname(os.path.abspath(__file__))
-lib = dl.DynamicLibrary(extra_compile_flags=['-I' + base_dir])
+# SGF_INSTRUMENTATION=1 builds the parser with its hot-path counters, see `SGFParser.statistics`
+instrumentation_flags = ['-DSGF_INSTRUMENTATION=1'] if os.environ.get('SGF_INSTRUMENTATION', '0') != '0' else []
+lib = dl.DynamicLibrary(extra_compile_flags=['-I' + base_dir] + instrumentation_flags)
 lib.compile_string(
     r'''
 #include "parser.hpp"
-#include <cstring>
+#include "serializer.hpp"
 
 struct ParserObject {
     SGFParser* parser;
@@ -65,54 +72,35 @@ API size_t calculate_num_nodes(ParserObject* obj) {
 }
 
 /**
- * Convert the tree structure into a compact representation using depth-first traversal.
+ * Convert the tree structure into a compact representation, see `SGFTreeSerializer::serialize`.
  *
- * @param obj The parser object containing the tree structure and relevant metadata.
- * @param tag_value_string A single continuous string that holds all tag and value pairs in depth-first order.
- *                         The string is split based on the sizes provided in `tag_value_sizes`.
- *                         Size: `calculate_tag_value_string_size(obj)` returns the total size of this string.
- * @param tag_value_sizes An array of sizes corresponding to each tag or value in `tag_value_string`,
- *                        allowing correct splitting of the string into individual tags and values.
- *                        Size: `calculate_num_tag_value(obj)` returns the total number of tags and values.
- * @param is_tag A boolean (char) array indicating whether each segment in `tag_value_string` is a tag (true) or a value (false).
- *               This helps differentiate between property names and their associated values.
- *               Size: Same as `tag_value_sizes`.
- * @param tag_value_count An array that specifies how many tag-value pairs each node contains. This array helps in
- *                        reconstructing the tree structure from the linearized tag-value pairs.
- *                        Size: `calculate_num_nodes(obj)` returns the total number of nodes.
- * @param parent_indices An array that stores the parent index for each node during depth-first traversal.
- *                       The root node will have a parent index of `-1`. Size: `calculate_num_nodes(obj)`.
+ * Sizes: `calculate_tag_value_string_size(obj)` for `tag_value_string`, `calculate_num_tag_value(obj)` for
+ * `tag_value_sizes` and `is_tag`, and `calculate_num_nodes(obj)` for `tag_value_count` and `parent_indices`.
  */
 API void serialize_tree(ParserObject* obj, char* tag_value_string, size_t tag_value_sizes[], char is_tag[], size_t tag_value_count[], size_t parent_indices[]) {
-    // Use depth-first search (DFS) to convert the tree structure into a compact representation
-    size_t offset = 0;
-    size_t tag_value_index = 0;
-    size_t node_index = 0;
-    std::function<void(StringSGFNode*, size_t)> dfs = [&](StringSGFNode* node, size_t parent_index) {
-        // Serialize the tag-value pairs of the current node
-        strcpy(tag_value_string + offset, node->content.c_str());  // node->content is a string that holds all tag-value pairs
-        offset += node->content.size();
-
-        // Serialize the tag-value sizes and is_tag array
-        // assert(node->tag_value_sizes.size() == node->is_tag.size());
-        for (size_t i = 0; i < node->tag_value_sizes.size(); i++) {
-            tag_value_sizes[tag_value_index] = node->tag_value_sizes[i];
-            is_tag[tag_value_index] = node->is_tag[i];
-            tag_value_index++;
-        }
-
-        // Serialize the node tag count and parent indices
-        size_t current_node_index = node_index++;
-        tag_value_count[current_node_index] = node->tag_value_sizes.size();
-        parent_indices[current_node_index] = parent_index;
-
-        auto child = static_cast<StringSGFNode*>(node->child);
-        while (child != nullptr) {
-            dfs(child, current_node_index);
-            child = static_cast<StringSGFNode*>(child->next_sibling);
-        }
-    };
-    dfs(obj->root, -1);
+    SGFTreeSerializer::serialize(obj->root, tag_value_string, tag_value_sizes, is_tag, tag_value_count, parent_indices);
+}
+
+API bool instrumentation_enabled() {
+    return SGF_INSTRUMENTATION_ENABLED;
+}
+
+/**
+ * counters: token counts per `SGFTokenType`, value bytes, structure bytes, node allocations, max stack depth.
+ * seconds: lex seconds, parse seconds.
+ */
+API void get_statistics(ParserObject* obj, size_t counters[], double seconds[]) {
+    SGFStatistics stats = obj->parser->statistics();
+    size_t i = 0;
+    for (size_t count : stats.token_counts) {
+        counters[i++] = count;
+    }
+    counters[i++] = stats.value_bytes;
+    counters[i++] = stats.structure_bytes;
+    counters[i++] = stats.node_allocations;
+    counters[i++] = stats.max_stack_depth;
+    seconds[0] = stats.lex_seconds;
+    seconds[1] = stats.parse_seconds;
 }
 ''', functions={
         'create_parser': {'argtypes': [dl.char_p, dl.uint64, dl.void_p], 'restype': dl.void_p},
@@ -122,8 +110,28 @@ API void serialize_tree(ParserObject* obj, char* tag_value_string, size_t tag_va
         'calculate_num_tag_value': {'argtypes': [dl.void_p], 'restype': dl.uint64},
         'calculate_num_nodes': {'argtypes': [dl.void_p], 'restype': dl.uint64},
         'serialize_tree': {'argtypes': [dl.void_p, dl.int8_p, dl.npint64arr, dl.npint8arr, dl.npint64arr, dl.npint64arr], 'restype': dl.void},
+        'instrumentation_enabled': {'argtypes': [], 'restype': dl.bool},
+        'get_statistics': {'argtypes': [dl.void_p, dl.npuint64arr, dl.npdoublearr], 'restype': dl.void},
     })
 
+TOKEN_TYPE_NAMES = ['left_paren', 'right_paren', 'semicolon', 'tag', 'value', 'ignore', 'end', 'none']
+
+
+def _get_statistics(parser) -> typing.Dict[str, typing.Any]:
+    counters = np.zeros(len(TOKEN_TYPE_NAMES) + 4, dtype=np.uint64)
+    seconds = np.zeros(2, dtype=np.float64)
+    lib.get_statistics(parser, counters, seconds)  # type: ignore[attr-defined]
+    counts = [int(c) for c in counters]
+    return {
+        'token_counts': dict(zip(TOKEN_TYPE_NAMES, counts)),
+        'value_bytes': counts[-4],
+        'structure_bytes': counts[-3],
+        'node_allocations': counts[-2],
+        'max_stack_depth': counts[-1],
+        'lex_seconds': float(seconds[0]),
+        'parse_seconds': float(seconds[1]),
+    }
+
 
 class AllocateOnlyNodePool(typing.Generic[T]):
     def __init__(self, size: int, node_allocator: NodeAllocator[T]):
@@ -147,8 +155,14 @@ class SGFParser(typing.Generic[T]):
         self.node_allocator = node_allocator
         self.node_pool: typing.Optional[AllocateOnlyNodePool[T]] = None
         self.node_pool_thread: typing.Optional[threading.Thread] = None
+        # counters of the last parse, only filled when the library was built with SGF_INSTRUMENTATION=1
+        self.statistics: typing.Optional[typing.Dict[str, typing.Any]] = None
 
     def parse(self, sgf: str, start: int = 0, show_progress: bool = False) -> T:
+        # the instrumented parser is only reachable through ctypes
+        if cnative is not None and not lib.instrumentation_enabled():  # type: ignore[attr-defined]
+            return self._parse_native(sgf, start, show_progress)
+
         start_time: typing.Optional[float] = None
         if show_progress:
             start_time = time.time()
@@ -178,6 +192,43 @@ class SGFParser(typing.Generic[T]):
                 f"| Total time: {end_time - start_time:.2f}s", file=sys.stderr)
         return root
 
+    def parse_flat(self, sgf: str, start: int = 0) -> 'cnative.FlatTree':
+        """Parse into a `cnative.FlatTree` without creating any Python node."""
+        if cnative is None:
+            raise RuntimeError("The native extension is not available")
+        return cnative.parse(sgf, start)
+
+    def parse_lazy(self, sgf: str, start: int = 0, show_progress: bool = False, index: bool = False) -> LazySGFNode:
+        """
+        Parse into the native flat tree and return a lazy root, see `LazySGFNode`.
+
+        Python nodes are only created for the nodes visited, and `node_allocator` is not used. With
+        `index`, a (tag, value) index is built along with the tree and answers
+        `Algorithm.find_nodes_with_property` in time proportional to the matches.
+        """
+        if cnative is None:
+            raise RuntimeError("The native extension is not available")
+        Progress = DummyTimer if not show_progress else Timer
+        with Progress("Parsing SGF..."):
+            root = LazySGFTree(cnative.parse(sgf, start, index)).root()
+        assert root is not None
+        return root
+
+    def _parse_native(self, sgf: str, start: int = 0, show_progress: bool = False) -> T:
+        Progress = DummyTimer if not show_progress else Timer
+        start_time = time.time()
+
+        with Progress("[1/2] Parsing SGF...", end="\r"):
+            tree = cnative.parse(sgf, start)
+
+        with Progress("[2/2] Constructing tree...", end=" "):
+            root = tree.build(self.node_allocator.allocate)
+
+        if show_progress:
+            print(f"| Total time: {time.time() - start_time:.2f}s", file=sys.stderr)
+        assert root is not None
+        return root
+
     def _parse(self, sgf: str, start: int = 0, show_progress: bool = False) -> typing.Tuple[bytearray, np.ndarray, np.ndarray, np.ndarray, np.ndarray]:
         Progress = DummyTimer if not show_progress else Timer
 
@@ -188,6 +239,8 @@ class SGFParser(typing.Generic[T]):
         # Parse the SGF string
         with Progress("[2/7] Parsing SGF...", end="\r"):
             lib.parse(parser)  # type: ignore[attr-defined]
+        if lib.instrumentation_enabled():  # type: ignore[attr-defined]
+            self.statistics = _get_statistics(parser)
 
         # Calculate the sizes of the tag-value string and the number of tag-value pairs
         with Progress("[3/7] Fetching tree metadata...", end="\r"):
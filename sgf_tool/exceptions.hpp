@@ -17,7 +17,12 @@ public:
                   int e = std::min(static_cast<int>(sgf.length()), end + offset);
                   return message + " at " + std::to_string(start) + ":" + std::to_string(end) + "\n" + sgf.substr(s, start - s) + highlight_start + sgf.substr(start, end - start) + highlight_end + sgf.substr(end, e - end);
               }
-          }()) {}
+          }()),
+          message(message), start(start), end(end) {}
+
+    std::string message;
+    int start;
+    int end;
 };
 
 class LexicalError : public BaseSGFException {
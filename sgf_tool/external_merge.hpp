@@ -0,0 +1,599 @@
+#pragma once
+
+#include "parser.hpp"
+#include "tree_merge.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+// Read-only memory mapping of a whole file, so that inputs larger than memory can be parsed.
+class SGFMappedFile {
+public:
+    explicit SGFMappedFile(const std::string& path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot open " + path + ": " + std::strerror(errno));
+        }
+        struct stat st;
+        if (::fstat(fd, &st) < 0) {
+            ::close(fd);
+            throw std::runtime_error("Cannot stat " + path + ": " + std::strerror(errno));
+        }
+        size = static_cast<size_t>(st.st_size);
+        if (size > 0) {
+            void* mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("Cannot map " + path + ": " + std::strerror(errno));
+            }
+            ::madvise(mapping, size, MADV_SEQUENTIAL);
+            data = static_cast<const char*>(mapping);
+        }
+        ::close(fd);
+    }
+
+    ~SGFMappedFile()
+    {
+        if (data != nullptr) {
+            ::munmap(const_cast<char*>(data), size);
+        }
+    }
+
+    SGFMappedFile(const SGFMappedFile&) = delete;
+    SGFMappedFile& operator=(const SGFMappedFile&) = delete;
+
+    SGFInputView view() const
+    {
+        return {data != nullptr ? data : "", size};
+    }
+
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+};
+
+/**
+ * The nodes of an SGF document in pre-order with their depth, from `SGFParser::next_node`.
+ *
+ * Nodes are not linked to their siblings and are deleted as soon as the parser is past their
+ * subtree, so only the path to the current node is in memory however large the tree is.
+ */
+class SGFStreamReader {
+public:
+    struct Node {
+        size_t depth = 0;
+        std::vector<SGFMergePolicy::Property> properties;
+    };
+
+    explicit SGFStreamReader(SGFInputView input) : parser(input, allocator) {}
+
+    bool next(Node& node)
+    {
+        auto* parsed = static_cast<StreamNode*>(parser.next_node());
+        if (parsed == nullptr) {
+            return false;
+        }
+        node.depth = parsed->depth;
+        node.properties.clear();
+        size_t offset = 0;
+        size_t current = 0;
+        for (size_t i = 0; i < parsed->tag_value_sizes.size(); ++i) {
+            std::string text = parsed->content.substr(offset, parsed->tag_value_sizes[i]);
+            offset += parsed->tag_value_sizes[i];
+            if (!parsed->is_tag[i]) {
+                node.properties[current].values.push_back(std::move(text));
+                continue;
+            }
+            // a repeated tag keeps its first position and its last values, as with `node[tag] = values`
+            auto it = std::find_if(node.properties.begin(), node.properties.end(), [&](const auto& p) { return p.tag == text; });
+            current = it - node.properties.begin();
+            if (it == node.properties.end()) {
+                node.properties.push_back({std::move(text), {}});
+            } else {
+                it->values.clear();
+            }
+        }
+        return true;
+    }
+
+private:
+    class StreamNode : public StringSGFNode {
+    public:
+        void addChild(BaseSGFNode* node) override
+        {
+            node->parent = this;
+            static_cast<StreamNode*>(node)->depth = depth + 1;
+        }
+
+        size_t depth = 0;
+    };
+
+    // Keeps the nodes on the path to the last allocated node and deletes the others.
+    class StreamAllocator : public BaseNodeAllocator {
+    public:
+        ~StreamAllocator()
+        {
+            for (StreamNode* node : path) {
+                delete node;
+            }
+            delete last;
+        }
+
+        BaseSGFNode* allocate() override
+        {
+            // the depth of the previous node is known by now, and every node it does not descend from
+            // has been returned by the parser; the root stays until the end, the parser detaches it last
+            if (last != nullptr) {
+                while (!path.empty() && path.back()->depth >= last->depth && path.back()->depth > 0) {
+                    delete path.back();
+                    path.pop_back();
+                }
+                path.push_back(last);
+            }
+            last = new StreamNode();
+            return last;
+        }
+
+        void deallocate(BaseSGFNode* node) override
+        {
+            delete static_cast<StreamNode*>(node);
+        }
+
+    private:
+        std::vector<StreamNode*> path;
+        StreamNode* last = nullptr;
+    };
+
+    // destroyed after the parser
+    StreamAllocator allocator;
+    SGFParser parser;
+};
+
+/**
+ * Streaming k-way merge of SGF files into one, in memory bounded by `memory_budget`.
+ *
+ * Every node becomes a record keyed by its path, the keys (values of `key_tags`) of the nodes from
+ * the root down to it. Sorting the records of all inputs by path gives the merged tree in pre-order,
+ * children sorted by key, with matched nodes next to each other; their properties are combined by
+ * `SGFMergePolicy` and the tree is written out as it goes. Siblings sharing a key within one input
+ * have the same path, so they are folded into one node as well, as in `SGFTreeMerger`. Inputs are sorted in runs of at most
+ * `memory_budget` bytes spilled to `spill_directory`, then merged with a heap, `max_fan_in` runs at
+ * a time. Inputs whose children are already sorted by key (as written by this merger) can skip the
+ * spill with `presorted`, and are then read in a single pass.
+ */
+class SGFExternalMerger {
+public:
+    struct Options {
+        std::vector<std::string> key_tags{"B", "W"};
+        size_t memory_budget = size_t(256) << 20;
+        std::string spill_directory = "/tmp";
+        bool presorted = false;
+        size_t max_fan_in = 256;
+    };
+
+    struct Statistics {
+        size_t nodes_read = 0;
+        size_t nodes_written = 0;
+        size_t runs_spilled = 0;
+        size_t bytes_spilled = 0;
+    };
+
+    SGFExternalMerger(Options options, const SGFMergePolicy& policy) : options(std::move(options)), policy(policy) {}
+
+    Statistics merge(const std::vector<std::string>& inputs, const std::string& output)
+    {
+        statistics = Statistics();
+        std::vector<std::unique_ptr<Source>> sources;
+        if (options.presorted) {
+            for (const std::string& input : inputs) {
+                sources.push_back(std::make_unique<InputSource>(*this, input));
+            }
+        } else {
+            for (const std::string& input : inputs) {
+                spill_input(input, sources);
+            }
+            while (sources.size() > options.max_fan_in) {
+                // merge the first runs into one at their place, which keeps the order of equal paths
+                std::vector<std::unique_ptr<Source>> batch;
+                for (size_t i = 0; i < options.max_fan_in; ++i) {
+                    batch.push_back(std::move(sources[i]));
+                }
+                sources.erase(sources.begin(), sources.begin() + options.max_fan_in);
+                auto run = std::make_unique<Run>(options.spill_directory);
+                merge_sources(batch, [&](Record& record) { write_run_record(*run, record); });
+                run->finish();
+                sources.insert(sources.begin(), std::make_unique<RunSource>(std::move(run)));
+            }
+        }
+
+        FILE* out = std::fopen(output.c_str(), "wb");
+        if (out == nullptr) {
+            throw std::runtime_error("Cannot open " + output + ": " + std::strerror(errno));
+        }
+        std::unique_ptr<FILE, int (*)(FILE*)> out_guard(out, std::fclose);
+        Writer writer(out);
+        std::unique_ptr<Record> pending;
+        merge_sources(sources, [&](Record& record) {
+            if (pending != nullptr && pending->path == record.path) {
+                policy.merge(pending->properties, std::move(record.properties));
+                return;
+            }
+            if (pending != nullptr) {
+                writer.write(*pending);
+                ++statistics.nodes_written;
+            } else {
+                pending = std::make_unique<Record>();
+            }
+            std::swap(*pending, record);
+        });
+        if (pending != nullptr) {
+            writer.write(*pending);
+            ++statistics.nodes_written;
+        }
+        writer.finish();
+        if (std::fflush(out) != 0) {
+            throw std::runtime_error("Cannot write " + output + ": " + std::strerror(errno));
+        }
+        return statistics;
+    }
+
+private:
+    struct Record {
+        std::string path;
+        size_t depth = 0;
+        std::vector<SGFMergePolicy::Property> properties;
+
+        size_t memory() const
+        {
+            size_t bytes = sizeof(Record) + path.capacity();
+            for (const auto& property : properties) {
+                bytes += sizeof(property) + property.tag.capacity();
+                for (const auto& value : property.values) {
+                    bytes += sizeof(value) + value.capacity();
+                }
+            }
+            return bytes;
+        }
+    };
+
+    // A sorted stream of records.
+    class Source {
+    public:
+        virtual ~Source() = default;
+        virtual bool next(Record& record) = 0;
+    };
+
+    // Records of one input in document order, turning node depths into paths.
+    class InputSource : public Source {
+    public:
+        InputSource(SGFExternalMerger& merger, const std::string& path) : merger(merger), name(path), file(path), reader(file.view()) {}
+
+        bool next(Record& record) override
+        {
+            if (!reader.next(node)) {
+                return false;
+            }
+            if (node.depth == 0) {
+                if (seen_root) {
+                    throw std::invalid_argument(name + " holds more than one game");
+                }
+                seen_root = true;
+                if (!merger.root_key_set) {
+                    merger.root_key = merger.key(node.properties);
+                    merger.root_key_set = true;
+                } else if (merger.key(node.properties) != merger.root_key) {
+                    throw std::invalid_argument("The root of " + name + " differs from the others");
+                }
+            }
+            // the path of a node extends the path of its parent, the root has the empty path
+            prefix_lengths.resize(node.depth);
+            current_path.resize(node.depth == 0 ? 0 : prefix_lengths[node.depth - 1]);
+            if (node.depth > 0) {
+                current_path += separator;
+                current_path += merger.key(node.properties);
+            }
+            prefix_lengths.push_back(current_path.size());
+            ++merger.statistics.nodes_read;
+
+            record.path = current_path;
+            record.depth = node.depth;
+            record.properties = std::move(node.properties);
+            return true;
+        }
+
+        const std::string& input_name() const
+        {
+            return name;
+        }
+
+    private:
+        SGFExternalMerger& merger;
+        std::string name;
+        SGFMappedFile file;
+        SGFStreamReader reader;
+        SGFStreamReader::Node node;
+        std::vector<size_t> prefix_lengths;
+        std::string current_path;
+        bool seen_root = false;
+    };
+
+    // An unlinked temporary file, removed by the system once closed.
+    class Run {
+    public:
+        explicit Run(const std::string& directory)
+        {
+            std::string pattern = directory + "/sgf_merge_XXXXXX";
+            std::vector<char> name(pattern.begin(), pattern.end());
+            name.push_back('\0');
+            int fd = ::mkstemp(name.data());
+            if (fd < 0) {
+                throw std::runtime_error("Cannot create a spill file in " + directory + ": " + std::strerror(errno));
+            }
+            ::unlink(name.data());
+            file = ::fdopen(fd, "w+b");
+            if (file == nullptr) {
+                ::close(fd);
+                throw std::runtime_error(std::string("Cannot open a spill file: ") + std::strerror(errno));
+            }
+            std::setvbuf(file, nullptr, _IOFBF, 1 << 20);
+        }
+
+        ~Run()
+        {
+            std::fclose(file);
+        }
+
+        void write(const void* data, size_t size)
+        {
+            if (std::fwrite(data, 1, size, file) != size) {
+                throw std::runtime_error(std::string("Cannot write a spill file: ") + std::strerror(errno));
+            }
+            bytes += size;
+        }
+
+        bool read(void* data, size_t size)
+        {
+            return size == 0 || std::fread(data, 1, size, file) == size;
+        }
+
+        // Switch from writing to reading from the start.
+        void finish()
+        {
+            if (std::fflush(file) != 0 || std::fseek(file, 0, SEEK_SET) != 0) {
+                throw std::runtime_error(std::string("Cannot rewind a spill file: ") + std::strerror(errno));
+            }
+        }
+
+        size_t bytes = 0;
+
+    private:
+        FILE* file;
+    };
+
+    class RunSource : public Source {
+    public:
+        explicit RunSource(std::unique_ptr<Run> run) : run(std::move(run)) {}
+
+        bool next(Record& record) override
+        {
+            uint64_t depth;
+            if (!run->read(&depth, sizeof(depth))) {
+                return false;
+            }
+            record.depth = depth;
+            read_string(record.path);
+            uint32_t count = read_u32();
+            record.properties.resize(count);
+            for (auto& property : record.properties) {
+                read_string(property.tag);
+                property.values.resize(read_u32());
+                for (auto& value : property.values) {
+                    read_string(value);
+                }
+            }
+            return true;
+        }
+
+    private:
+        std::unique_ptr<Run> run;
+
+        uint32_t read_u32()
+        {
+            uint32_t value;
+            if (!run->read(&value, sizeof(value))) {
+                throw std::runtime_error("Truncated spill file");
+            }
+            return value;
+        }
+
+        void read_string(std::string& text)
+        {
+            text.resize(read_u32());
+            if (!run->read(text.data(), text.size())) {
+                throw std::runtime_error("Truncated spill file");
+            }
+        }
+    };
+
+    // Writes pre-order nodes with their depth as SGF, every variation in parentheses.
+    class Writer {
+    public:
+        explicit Writer(FILE* file) : file(file)
+        {
+            std::setvbuf(file, nullptr, _IOFBF, 1 << 20);
+        }
+
+        void write(const Record& record)
+        {
+            if (open) {
+                // close the variations of the previous node down to the parent of this one
+                for (size_t depth = record.depth; depth <= last_depth; ++depth) {
+                    put(")");
+                }
+            }
+            put("(;");
+            for (const auto& property : record.properties) {
+                put(property.tag);
+                for (const auto& value : property.values) {
+                    put("[");
+                    put(value);
+                    put("]");
+                }
+            }
+            open = true;
+            last_depth = record.depth;
+        }
+
+        void finish()
+        {
+            if (open) {
+                for (size_t depth = 0; depth <= last_depth; ++depth) {
+                    put(")");
+                }
+            }
+            put("\n");
+        }
+
+    private:
+        FILE* file;
+        bool open = false;
+        size_t last_depth = 0;
+
+        void put(const std::string& text)
+        {
+            if (std::fwrite(text.data(), 1, text.size(), file) != text.size()) {
+                throw std::runtime_error(std::string("Cannot write the merged tree: ") + std::strerror(errno));
+            }
+        }
+    };
+
+    static constexpr char separator = '\x01'; // sorts below any key, so a node precedes its descendants
+
+    Options options;
+    const SGFMergePolicy& policy;
+    Statistics statistics;
+    std::string root_key;
+    bool root_key_set = false;
+
+    // The key tags of a node with their values, e.g. "B[JJ]".
+    std::string key(const std::vector<SGFMergePolicy::Property>& properties) const
+    {
+        std::string result;
+        for (const std::string& tag : options.key_tags) {
+            auto it = std::find_if(properties.begin(), properties.end(), [&](const auto& p) { return p.tag == tag; });
+            if (it == properties.end()) {
+                continue;
+            }
+            result += tag;
+            for (const std::string& value : it->values) {
+                result.append("[").append(value).append("]");
+            }
+        }
+        return result;
+    }
+
+    // Sort the records of one input in runs of at most `memory_budget` bytes.
+    void spill_input(const std::string& input, std::vector<std::unique_ptr<Source>>& sources)
+    {
+        InputSource reader(*this, input);
+        std::vector<Record> buffer;
+        size_t memory = 0;
+        auto spill = [&]() {
+            if (buffer.empty()) {
+                return;
+            }
+            // stable, so equal paths keep the order of the input
+            std::stable_sort(buffer.begin(), buffer.end(), [](const Record& a, const Record& b) { return a.path < b.path; });
+            auto run = std::make_unique<Run>(options.spill_directory);
+            for (Record& record : buffer) {
+                write_run_record(*run, record);
+            }
+            run->finish();
+            ++statistics.runs_spilled;
+            statistics.bytes_spilled += run->bytes;
+            sources.push_back(std::make_unique<RunSource>(std::move(run)));
+            buffer.clear();
+            memory = 0;
+        };
+        Record record;
+        while (reader.next(record)) {
+            memory += record.memory();
+            buffer.push_back(std::move(record));
+            record = Record();
+            if (memory >= options.memory_budget) {
+                spill();
+            }
+        }
+        spill();
+    }
+
+    static void write_run_record(Run& run, const Record& record)
+    {
+        auto write_u32 = [&](size_t value) {
+            uint32_t v = static_cast<uint32_t>(value);
+            run.write(&v, sizeof(v));
+        };
+        auto write_string = [&](const std::string& text) {
+            write_u32(text.size());
+            run.write(text.data(), text.size());
+        };
+        uint64_t depth = record.depth;
+        run.write(&depth, sizeof(depth));
+        write_string(record.path);
+        write_u32(record.properties.size());
+        for (const auto& property : record.properties) {
+            write_string(property.tag);
+            write_u32(property.values.size());
+            for (const auto& value : property.values) {
+                write_string(value);
+            }
+        }
+    }
+
+    // Call `emit` with the records of all sources in path order, ties in the order of the sources.
+    template <typename Emit>
+    void merge_sources(std::vector<std::unique_ptr<Source>>& sources, Emit emit)
+    {
+        std::vector<Record> heads(sources.size());
+        auto greater = [&](size_t a, size_t b) {
+            int order = heads[a].path.compare(heads[b].path);
+            return order != 0 ? order > 0 : a > b;
+        };
+        std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(greater);
+        for (size_t i = 0; i < sources.size(); ++i) {
+            if (sources[i]->next(heads[i])) {
+                heap.push(i);
+            }
+        }
+        std::string previous;
+        std::vector<std::string> last_paths(sources.size());
+        while (!heap.empty()) {
+            size_t i = heap.top();
+            heap.pop();
+            if (heads[i].path < last_paths[i]) {
+                auto* input = dynamic_cast<InputSource*>(sources[i].get());
+                throw std::invalid_argument((input != nullptr ? input->input_name() : std::string("A spill run")) +
+                                            " is not sorted: children must be in key order with unique keys");
+            }
+            last_paths[i] = heads[i].path;
+            emit(heads[i]);
+            if (sources[i]->next(heads[i])) {
+                heap.push(i);
+            }
+        }
+    }
+};
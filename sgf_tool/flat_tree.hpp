@@ -0,0 +1,169 @@
+#pragma once
+
+#include "parser.hpp"
+#include "serializer.hpp"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * A parsed SGF tree stored as flat arrays in depth-first (pre-order) order.
+ *
+ * Node `i` owns the tag and value items `node_items[i]` to `node_items[i + 1]`. Item `j` is the
+ * byte range `item_offsets[j]` to `item_offsets[j + 1]` of `content` and is a tag if `is_tag[j]`
+ * is set, otherwise a value of the preceding tag. Links are node indices, -1 stands for none.
+ */
+struct SGFFlatTree {
+    std::string content;
+    std::vector<int64_t> item_offsets;
+    std::vector<uint8_t> is_tag;
+    std::vector<int64_t> node_items;
+    std::vector<int64_t> parent;
+    std::vector<int64_t> first_child;
+    std::vector<int64_t> next_sibling;
+
+    size_t num_nodes() const
+    {
+        return parent.size();
+    }
+
+    size_t num_items() const
+    {
+        return is_tag.size();
+    }
+
+    const char* item_data(size_t item) const
+    {
+        return content.data() + item_offsets[item];
+    }
+
+    size_t item_size(size_t item) const
+    {
+        return item_offsets[item + 1] - item_offsets[item];
+    }
+
+    // Append a node without items below `parent` (-1 for a root) and return its index.
+    int64_t add_node(int64_t parent_index)
+    {
+        if (node_items.empty()) {
+            node_items.push_back(0);
+            item_offsets.assign(1, 0);
+        }
+        parent.push_back(parent_index);
+        node_items.push_back(node_items.back());
+        return static_cast<int64_t>(parent.size()) - 1;
+    }
+
+    // Append a tag or value to the last node.
+    void add_item(std::string_view text, bool tag)
+    {
+        content.append(text);
+        item_offsets.push_back(content.size());
+        is_tag.push_back(tag);
+        ++node_items.back();
+    }
+
+    // Append every node of `subtree`, its root below `parent_index`.
+    void append_subtree(const SGFFlatTree& subtree, int64_t parent_index)
+    {
+        if (subtree.num_nodes() == 0) {
+            return;
+        }
+        if (node_items.empty()) {
+            node_items.push_back(0);
+            item_offsets.assign(1, 0);
+        }
+        int64_t node_base = static_cast<int64_t>(num_nodes());
+        int64_t item_base = static_cast<int64_t>(num_items());
+        int64_t content_base = static_cast<int64_t>(content.size());
+        content += subtree.content;
+        for (size_t i = 1; i < subtree.item_offsets.size(); ++i) {
+            item_offsets.push_back(content_base + subtree.item_offsets[i]);
+        }
+        is_tag.insert(is_tag.end(), subtree.is_tag.begin(), subtree.is_tag.end());
+        for (size_t i = 0; i < subtree.num_nodes(); ++i) {
+            parent.push_back(i == 0 ? parent_index : node_base + subtree.parent[i]);
+            node_items.push_back(item_base + subtree.node_items[i + 1]);
+        }
+    }
+
+    // Fill `first_child` and `next_sibling` from `parent`, for nodes added in pre-order.
+    void link_children()
+    {
+        size_t n = num_nodes();
+        first_child.assign(n, -1);
+        next_sibling.assign(n, -1);
+        std::vector<int64_t> last_child(n, -1);
+        for (size_t i = 0; i < n; ++i) {
+            int64_t p = parent[i];
+            if (p < 0) {
+                continue;
+            }
+            if (last_child[p] < 0) {
+                first_child[p] = i;
+            } else {
+                next_sibling[last_child[p]] = i;
+            }
+            last_child[p] = i;
+        }
+    }
+
+    /**
+     * Parse `sgf` and flatten the first game tree. Throws `LexicalError` or `SGFError` like `SGFParser`.
+     */
+    static SGFFlatTree parse(std::string sgf, size_t start = 0)
+    {
+        TrackingNodeAllocator<StringSGFNode> allocator;
+        SGFFlatTree tree;
+        try {
+            SGFParser parser(std::move(sgf), allocator, start);
+            auto root = static_cast<StringSGFNode*>(parser.next_node());
+            while (parser.next_node() != nullptr);
+            if (root != nullptr) {
+                tree = flatten(root, allocator);
+            }
+        } catch (...) {
+            allocator.deallocateAll();
+            throw;
+        }
+        allocator.deallocateAll();
+        return tree;
+    }
+
+private:
+    static SGFFlatTree flatten(const StringSGFNode* root, const TrackingNodeAllocator<StringSGFNode>& allocator)
+    {
+        size_t content_size = 0;
+        size_t num_items = 0;
+        for (const StringSGFNode* node : allocator.getAllocatedNodes()) {
+            content_size += node->content.size();
+            num_items += node->tag_value_sizes.size();
+        }
+        size_t num_nodes = allocator.getAllocatedNodes().size();
+
+        SGFFlatTree tree;
+        tree.content.resize(content_size);
+        std::vector<size_t> item_sizes(num_items);
+        std::vector<char> is_tag(num_items);
+        std::vector<size_t> item_counts(num_nodes);
+        std::vector<size_t> parent_indices(num_nodes);
+        SGFTreeSerializer::serialize(root, tree.content.data(), item_sizes.data(), is_tag.data(), item_counts.data(), parent_indices.data());
+
+        tree.item_offsets.resize(num_items + 1);
+        tree.is_tag.assign(is_tag.begin(), is_tag.end());
+        tree.item_offsets[0] = 0;
+        for (size_t i = 0; i < num_items; ++i) {
+            tree.item_offsets[i + 1] = tree.item_offsets[i] + item_sizes[i];
+        }
+        tree.node_items.resize(num_nodes + 1);
+        tree.node_items[0] = 0;
+        for (size_t i = 0; i < num_nodes; ++i) {
+            tree.node_items[i + 1] = tree.node_items[i] + item_counts[i];
+        }
+
+        tree.parent.assign(parent_indices.begin(), parent_indices.end());
+        tree.link_children();
+        return tree;
+    }
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+
+// Build with -DSGF_INSTRUMENTATION=1 to collect `SGFStatistics`, otherwise every hook compiles away.
+#ifndef SGF_INSTRUMENTATION
+#define SGF_INSTRUMENTATION 0
+#endif
+
+// Default number of bytes between two progress callbacks of `SGFLexer`.
+#ifndef SGF_PROGRESS_INTERVAL
+#define SGF_PROGRESS_INTERVAL (1 << 20)
+#endif
+
+constexpr bool SGF_INSTRUMENTATION_ENABLED = SGF_INSTRUMENTATION != 0;
+
+// One counter per `SGFTokenType`, including `ENDOFFILE` and `NONE`.
+constexpr size_t SGF_NUM_TOKEN_TYPES = 8;
+
+struct SGFStatistics {
+    size_t token_counts[SGF_NUM_TOKEN_TYPES] = {};
+    size_t value_bytes = 0;     // bytes inside `[...]`, brackets excluded
+    size_t structure_bytes = 0; // every other byte consumed: parentheses, semicolons, tags, brackets, whitespace
+    size_t node_allocations = 0;
+    size_t max_stack_depth = 0;
+    double lex_seconds = 0;
+    double parse_seconds = 0; // includes `lex_seconds`
+};
+
+/**
+ * Adds the lifetime of the scope to `seconds` when instrumentation is enabled and does nothing otherwise.
+ */
+class SGFScopedTimer {
+    using Clock = std::chrono::steady_clock;
+
+public:
+    explicit SGFScopedTimer(double& seconds) : seconds(seconds)
+    {
+        if constexpr (SGF_INSTRUMENTATION_ENABLED) {
+            start = Clock::now();
+        }
+    }
+
+    ~SGFScopedTimer()
+    {
+        if constexpr (SGF_INSTRUMENTATION_ENABLED) {
+            seconds += std::chrono::duration<double>(Clock::now() - start).count();
+        }
+    }
+
+    SGFScopedTimer(const SGFScopedTimer&) = delete;
+    SGFScopedTimer& operator=(const SGFScopedTimer&) = delete;
+
+private:
+    double& seconds;
+    Clock::time_point start;
+};
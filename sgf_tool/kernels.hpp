@@ -0,0 +1,172 @@
+#pragma once
+
+#include <cstddef>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define SGF_X86_DISPATCH 1
+#include <immintrin.h>
+#else
+#define SGF_X86_DISPATCH 0
+#endif
+
+enum class SGFKernelLevel : int {
+    SCALAR,
+    SSE2,
+    AVX2,
+    AVX512,
+};
+
+/**
+ * Hot scanning kernels of the lexer with runtime CPU dispatch.
+ *
+ * Every kernel is compiled for several instruction sets through `target` attributes, so a single
+ * generic `-O3` build runs the AVX-512 path on hosts that have AVX-512BW and falls back to AVX2,
+ * SSE2 or plain C++ elsewhere. The best supported level is picked on first use and can be lowered
+ * with `select`, e.g. to compare the paths in a benchmark.
+ */
+class SGFKernels {
+public:
+    using FindFunction = const char* (*)(const char*, const char*);
+
+    // The first ']', '\\' or '\0' in [begin, end), or `end` if there is none.
+    static const char* find_value_delimiter(const char* begin, const char* end)
+    {
+        return state().find(begin, end);
+    }
+
+    static SGFKernelLevel level()
+    {
+        return state().level;
+    }
+
+    static SGFKernelLevel best_supported()
+    {
+#if SGF_X86_DISPATCH
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512bw")) {
+            return SGFKernelLevel::AVX512;
+        }
+        if (__builtin_cpu_supports("avx2")) {
+            return SGFKernelLevel::AVX2;
+        }
+        if (__builtin_cpu_supports("sse2")) {
+            return SGFKernelLevel::SSE2;
+        }
+#endif
+        return SGFKernelLevel::SCALAR;
+    }
+
+    // Use `level`, or the best supported level below it. Returns the level in use.
+    static SGFKernelLevel select(SGFKernelLevel level)
+    {
+        if (static_cast<int>(level) > static_cast<int>(best_supported())) {
+            level = best_supported();
+        }
+        state() = resolve(level);
+        return level;
+    }
+
+    static const char* level_name(SGFKernelLevel level)
+    {
+        switch (level) {
+            case SGFKernelLevel::AVX512:
+                return "avx512";
+            case SGFKernelLevel::AVX2:
+                return "avx2";
+            case SGFKernelLevel::SSE2:
+                return "sse2";
+            default:
+                return "scalar";
+        }
+    }
+
+private:
+    struct State {
+        SGFKernelLevel level;
+        FindFunction find;
+    };
+
+    static State& state()
+    {
+        static State s = resolve(best_supported());
+        return s;
+    }
+
+    static State resolve(SGFKernelLevel level)
+    {
+        switch (level) {
+#if SGF_X86_DISPATCH
+            case SGFKernelLevel::AVX512:
+                return {level, find_value_delimiter_avx512};
+            case SGFKernelLevel::AVX2:
+                return {level, find_value_delimiter_avx2};
+            case SGFKernelLevel::SSE2:
+                return {level, find_value_delimiter_sse2};
+#endif
+            default:
+                return {SGFKernelLevel::SCALAR, find_value_delimiter_scalar};
+        }
+    }
+
+    static bool is_value_delimiter(char c)
+    {
+        return c == ']' || c == '\\' || c == '\0';
+    }
+
+    static const char* find_value_delimiter_scalar(const char* begin, const char* end)
+    {
+        while (begin < end && !is_value_delimiter(*begin)) {
+            ++begin;
+        }
+        return begin;
+    }
+
+#if SGF_X86_DISPATCH
+    __attribute__((target("sse2"))) static const char* find_value_delimiter_sse2(const char* begin, const char* end)
+    {
+        const __m128i bracket = _mm_set1_epi8(']');
+        const __m128i backslash = _mm_set1_epi8('\\');
+        const __m128i zero = _mm_setzero_si128();
+        for (; end - begin >= 16; begin += 16) {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+            __m128i match = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, bracket), _mm_cmpeq_epi8(chunk, backslash)), _mm_cmpeq_epi8(chunk, zero));
+            int mask = _mm_movemask_epi8(match);
+            if (mask != 0) {
+                return begin + __builtin_ctz(mask);
+            }
+        }
+        return find_value_delimiter_scalar(begin, end);
+    }
+
+    __attribute__((target("avx2"))) static const char* find_value_delimiter_avx2(const char* begin, const char* end)
+    {
+        const __m256i bracket = _mm256_set1_epi8(']');
+        const __m256i backslash = _mm256_set1_epi8('\\');
+        const __m256i zero = _mm256_setzero_si256();
+        for (; end - begin >= 32; begin += 32) {
+            __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+            __m256i match = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, bracket), _mm256_cmpeq_epi8(chunk, backslash)), _mm256_cmpeq_epi8(chunk, zero));
+            unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(match));
+            if (mask != 0) {
+                return begin + __builtin_ctz(mask);
+            }
+        }
+        return find_value_delimiter_sse2(begin, end);
+    }
+
+    __attribute__((target("avx512f,avx512bw"))) static const char* find_value_delimiter_avx512(const char* begin, const char* end)
+    {
+        const __m512i bracket = _mm512_set1_epi8(']');
+        const __m512i backslash = _mm512_set1_epi8('\\');
+        const __m512i zero = _mm512_setzero_si512();
+        for (; end - begin >= 64; begin += 64) {
+            __m512i chunk = _mm512_loadu_si512(reinterpret_cast<const void*>(begin));
+            __mmask64 mask = _mm512_cmpeq_epi8_mask(chunk, bracket) | _mm512_cmpeq_epi8_mask(chunk, backslash) | _mm512_cmpeq_epi8_mask(chunk, zero);
+            if (mask != 0) {
+                return begin + __builtin_ctzll(mask);
+            }
+        }
+        return find_value_delimiter_avx2(begin, end);
+    }
+#endif
+};
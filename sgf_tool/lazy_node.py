@@ -0,0 +1,100 @@
+from collections import OrderedDict
+import typing
+
+from .node import SGFNode
+
+if typing.TYPE_CHECKING:
+    from .cnative import FlatTree
+
+
+class LazySGFTree:
+    """
+    Owner of a native `FlatTree` handing out one `LazySGFNode` per flat node, created on first use.
+
+    Only the nodes reached from the root (or through `node`) ever become Python objects, so memory
+    and time scale with the nodes visited rather than the nodes parsed.
+    """
+
+    def __init__(self, flat: 'FlatTree'):
+        self.flat = flat
+        # memoryviews over the native arrays, indexing them does not copy
+        self.parent = flat.parent
+        self.first_child = flat.first_child
+        self.next_sibling = flat.next_sibling
+        self.nodes: typing.Dict[int, LazySGFNode] = {}
+        # set by the first change through a node, after which the flat arrays no longer describe the tree
+        self.modified = False
+
+    def __len__(self) -> int:
+        return len(self.flat)
+
+    @property
+    def num_materialized(self) -> int:
+        return len(self.nodes)
+
+    def root(self) -> typing.Optional['LazySGFNode']:
+        return self.node(0) if len(self.flat) > 0 else None
+
+    def node(self, index: int) -> typing.Optional['LazySGFNode']:
+        if index < 0:
+            return None
+        node = self.nodes.get(index)
+        if node is None:
+            node = LazySGFNode(self, index)
+            self.nodes[index] = node
+        return node
+
+
+class LazySGFNode(SGFNode):
+    """
+    `SGFNode` whose links and properties are read from a `LazySGFTree` the first time they are used.
+
+    Every attribute of `SGFNode` is filled in by `__getattr__` on first access and then behaves like
+    a plain attribute, so the node can be read and modified like any other `SGFNode`. Mutations go
+    through the attributes they change, which resolves them first, so nodes that are still lazy keep
+    seeing the links they had in the flat tree. Changes through `__setitem__`, `add_child` and
+    `detach` mark the tree as modified, changes made to `properties` directly do not.
+    """
+
+    def __init__(self, tree: LazySGFTree, index: int):
+        self.tree = tree
+        self.index = index
+
+    def __getattr__(self, name):
+        # only called for attributes that are not set yet
+        if name not in ('properties', 'parent', 'child', 'next_sibling', 'num_children'):
+            raise AttributeError(name)
+        tree = self.__dict__.get('tree')
+        if tree is None:
+            raise AttributeError(name)
+        index = self.index
+
+        if name == 'properties':
+            value = OrderedDict(tree.flat.properties(index))
+        elif name == 'parent':
+            value = tree.node(tree.parent[index])
+        elif name == 'child':
+            value = tree.node(tree.first_child[index])
+        elif name == 'next_sibling':
+            value = tree.node(tree.next_sibling[index])
+        else:
+            value = 0
+            child = tree.first_child[index]
+            while child >= 0:
+                value += 1
+                child = tree.next_sibling[child]
+        setattr(self, name, value)
+        return value
+
+    def __setitem__(self, key, value):
+        self.tree.modified = True
+        super().__setitem__(key, value)
+
+    def add_child(self, child):
+        self.tree.modified = True
+        super().add_child(child)
+
+    def detach(self):
+        if self.parent is not None:
+            self.tree.modified = True
+        return super().detach()
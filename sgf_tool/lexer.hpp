@@ -1,7 +1,11 @@
 #pragma once
 
 #include "exceptions.hpp"
+#include "instrumentation.hpp"
+#include "kernels.hpp"
+#include <algorithm>
 #include <functional>
+#include <limits>
 #include <sstream>
 #include <stdexcept>
 #include <string>
@@ -38,25 +42,38 @@ public:
     virtual int tellg() = 0;
 };
 
+// Input owned by the caller, which keeps it alive and unchanged for the lifetime of the lexer, e.g. a memory-mapped file.
+struct SGFInputView {
+    const char* data;
+    size_t size;
+};
+
 class StringInputStream : public BaseInputStream {
 public:
-    explicit StringInputStream(const std::string& s)
-        : s(s), index(0) {}
+    explicit StringInputStream(std::string s)
+        : owned(std::move(s)), data(owned.data()), size(owned.size()), index(0) {}
+
+    explicit StringInputStream(SGFInputView view)
+        : data(view.data), size(view.size), index(0) {}
+
+    // `data` may point into `owned`
+    StringInputStream(const StringInputStream&) = delete;
+    StringInputStream& operator=(const StringInputStream&) = delete;
 
     char peek() override
     {
-        if (index >= s.length()) {
+        if (index >= size) {
             return '\0';
         }
-        return s[index];
+        return data[index];
     }
 
     char get() override
     {
-        if (index >= s.length()) {
+        if (index >= size) {
             return '\0';
         }
-        return s[index++];
+        return data[index++];
     }
 
     void unget() override
@@ -71,21 +88,63 @@ public:
         return index;
     }
 
+    // Direct access to the remaining input for the scanning kernels.
+    const char* current() const
+    {
+        return data + index;
+    }
+
+    const char* end() const
+    {
+        return data + size;
+    }
+
+    void seek(const char* position)
+    {
+        index = position - data;
+    }
+
 private:
-    std::string s;
+    std::string owned;
+    const char* data;
+    size_t size;
     size_t index;
 };
 
 class SGFLexer {
 public:
-    SGFLexer(std::string sgf, size_t start = 0, std::function<void(int, int)> progress_callback = nullptr)
-        : length(sgf.length()), input_stream(std::move(sgf)), last_token(SGFTokenType::NONE, "", start, start), progress_callback(std::move(progress_callback)) {}
+    /**
+     * @param progress_callback Called with (position, length) each time at least `progress_interval` bytes
+     *                          have been consumed since the last call, and once more at the end of the input.
+     */
+    SGFLexer(std::string sgf, size_t start = 0, std::function<void(int, int)> progress_callback = nullptr, size_t progress_interval = SGF_PROGRESS_INTERVAL)
+        : length(sgf.length()), input_stream(std::move(sgf)), last_token(SGFTokenType::NONE, "", start, start), progress_callback(std::move(progress_callback)),
+          progress_interval(progress_interval), next_progress(progress_interval) {}
+
+    SGFLexer(SGFInputView sgf, size_t start = 0, std::function<void(int, int)> progress_callback = nullptr, size_t progress_interval = SGF_PROGRESS_INTERVAL)
+        : length(sgf.size), input_stream(sgf), last_token(SGFTokenType::NONE, "", start, start), progress_callback(std::move(progress_callback)),
+          progress_interval(progress_interval), next_progress(progress_interval) {}
 
     const SGFToken& next_token()
     {
-        _next_token();
-        if (last_token.type != SGFTokenType::ENDOFFILE && progress_callback) {
-            progress_callback(input_stream.tellg(), length);
+        {
+            SGFScopedTimer timer(stats.lex_seconds);
+            _next_token();
+        }
+        if constexpr (SGF_INSTRUMENTATION_ENABLED) {
+            ++stats.token_counts[static_cast<int>(last_token.type)];
+            if (last_token.type == SGFTokenType::VALUE) {
+                stats.value_bytes += last_token.value.size();
+            }
+            stats.structure_bytes = input_stream.tellg() - stats.value_bytes;
+        }
+        if (progress_callback) {
+            size_t position = input_stream.tellg();
+            if (last_token.type == SGFTokenType::ENDOFFILE || position >= next_progress) {
+                progress_callback(position, length);
+                // report the end of the input only once
+                next_progress = last_token.type == SGFTokenType::ENDOFFILE ? std::numeric_limits<size_t>::max() : position + progress_interval;
+            }
         }
         return last_token;
     }
@@ -95,6 +154,12 @@ public:
         return last_token;
     }
 
+    // Counters collected so far, all zero unless built with SGF_INSTRUMENTATION.
+    const SGFStatistics& statistics() const
+    {
+        return stats;
+    }
+
 private:
     void _next_token()
     {
@@ -121,22 +186,24 @@ private:
             }
             if (c == '[') {
                 std::string value;
-                bool escape = false;
+                const char* p = input_stream.current();
+                const char* end = input_stream.end();
                 while (true) {
-                    c = input_stream.get();
-                    if (c == '\0') {
-                        throw LexicalError("Unexpected end of file", input_stream.tellg(), input_stream.tellg());
-                    }
-                    if (c == ']' && !escape) {
-                        break;
-                    }
-                    if (c == '\\' && !escape) {
-                        value += c; // Add the escape character
-                        escape = true;
+                    // copy everything up to the next ']', '\\' or '\0' at once
+                    const char* q = SGFKernels::find_value_delimiter(p, end);
+                    value.append(p, q);
+                    if (q != end && *q == '\\' && q + 1 != end && q[1] != '\0') {
+                        value.append(q, 2); // the escape character and the escaped one
+                        p = q + 2;
                         continue;
                     }
-                    value += c;
-                    escape = false;
+                    if (q == end || *q != ']') {
+                        // the end of the input or a '\0', possibly escaped, which is reported after the '\0'
+                        input_stream.seek(q == end ? end : *q == '\\' ? std::min(q + 2, end) : q + 1);
+                        throw LexicalError("Unexpected end of file", input_stream.tellg(), input_stream.tellg());
+                    }
+                    input_stream.seek(q + 1);
+                    break;
                 }
                 // return std::make_unique<SGFToken>(SGFTokenType::VALUE, value, input_stream.tellg() - value.size() - 1, input_stream.tellg());
                 last_token = SGFToken(SGFTokenType::VALUE, value, input_stream.tellg() - value.size() - 1, input_stream.tellg());
@@ -171,4 +238,7 @@ private:
     StringInputStream input_stream;
     SGFToken last_token;
     std::function<void(int, int)> progress_callback;
+    size_t progress_interval;
+    size_t next_progress;
+    SGFStatistics stats;
 };
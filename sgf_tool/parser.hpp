@@ -1,7 +1,9 @@
 #pragma once
 
 #include "exceptions.hpp"
+#include "instrumentation.hpp"
 #include "lexer.hpp"
+#include <algorithm>
 #include <stack>
 #include <stdexcept>
 #include <string>
@@ -164,8 +166,19 @@ class SGFParser {
     };
 
 public:
-    SGFParser(std::string sgf, BaseNodeAllocator& allocator, size_t start = 0, std::function<void(int, int)> progress_callback = nullptr)
-        : lexer(std::move(sgf), start, std::move(progress_callback)), allocator(allocator), root(new DummyNode()), current(root)
+    SGFParser(std::string sgf, BaseNodeAllocator& allocator, size_t start = 0, std::function<void(int, int)> progress_callback = nullptr, size_t progress_interval = SGF_PROGRESS_INTERVAL)
+        : lexer(std::move(sgf), start, std::move(progress_callback), progress_interval), allocator(allocator), root(new DummyNode()), current(root)
+    {
+        next_can_be_left_paren = true;
+        next_can_be_right_paren = false;
+        next_can_be_semicolon = false;
+        next_can_be_tag = false;
+        next_can_be_value = false;
+    }
+
+    // Parse input owned by the caller, see `SGFInputView`.
+    SGFParser(SGFInputView sgf, BaseNodeAllocator& allocator, size_t start = 0, std::function<void(int, int)> progress_callback = nullptr, size_t progress_interval = SGF_PROGRESS_INTERVAL)
+        : lexer(sgf, start, std::move(progress_callback), progress_interval), allocator(allocator), root(new DummyNode()), current(root)
     {
         next_can_be_left_paren = true;
         next_can_be_right_paren = false;
@@ -181,6 +194,7 @@ public:
 
     BaseSGFNode* next_node()
     {
+        SGFScopedTimer timer(parse_seconds);
         auto cache_tag = std::string();
         auto cache_values = std::vector<std::string>();
         // bool has_value = false;
@@ -198,6 +212,7 @@ public:
 
                     stack.push({Element::Type::NODE, 0, 0, current});
                     stack.push({Element::Type::LEFT_PAREN, token.start, token.end, nullptr}); // append '(' token to stack
+                    update_max_stack_depth();
 
                     // update states
                     next_can_be_left_paren = false;
@@ -274,6 +289,10 @@ public:
                     stack.push({Element::Type::NODE, 0, 0, current});
                     current = allocator.allocate();
                     stack.top().node->addChild(current);
+                    if constexpr (SGF_INSTRUMENTATION_ENABLED) {
+                        ++node_allocations;
+                    }
+                    update_max_stack_depth();
                     // content = token.value;  // begin the content of the new node (';')
 
                     // update states
@@ -364,7 +383,24 @@ public:
         return nullptr;
     }
 
+    // Lexer and parser counters collected so far, all zero unless built with SGF_INSTRUMENTATION.
+    SGFStatistics statistics() const
+    {
+        SGFStatistics stats = lexer.statistics();
+        stats.node_allocations = node_allocations;
+        stats.max_stack_depth = max_stack_depth;
+        stats.parse_seconds = parse_seconds;
+        return stats;
+    }
+
 private:
+    void update_max_stack_depth()
+    {
+        if constexpr (SGF_INSTRUMENTATION_ENABLED) {
+            max_stack_depth = std::max(max_stack_depth, stack.size());
+        }
+    }
+
     SGFLexer lexer;
     BaseNodeAllocator& allocator;
     std::stack<Element> stack;
@@ -377,4 +413,8 @@ private:
     bool next_can_be_semicolon;
     bool next_can_be_tag;
     bool next_can_be_value;
+
+    size_t node_allocations = 0;
+    size_t max_stack_depth = 0;
+    double parse_seconds = 0;
 };
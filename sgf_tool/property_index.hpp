@@ -0,0 +1,171 @@
+#pragma once
+
+#include "flat_tree.hpp"
+#include "tree_query.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * Secondary index of an `SGFFlatTree` from (tag, value) and from tag alone to the nodes having them.
+ *
+ * Each posting list holds ascending node indices as LEB128 varints of the gap to the previous one,
+ * all lists packed into one byte buffer, so a move coordinate used by thousands of nodes costs a
+ * byte or two per node. A lookup decodes only its own list and runs in O(matches).
+ */
+class SGFPropertyIndex {
+public:
+    explicit SGFPropertyIndex(const SGFFlatTree& tree)
+    {
+        // (key, node) pairs in node order, then grouped by key with a stable sort
+        std::vector<std::pair<uint32_t, int64_t>> entries;
+        entries.reserve(tree.num_items());
+        for (size_t node = 0; node < tree.num_nodes(); ++node) {
+            int64_t first = tree.node_items[node];
+            int64_t last = tree.node_items[node + 1];
+            for (int64_t item = first; item < last; ++item) {
+                if (!tree.is_tag[item] || shadowed(tree, item, last)) {
+                    continue;
+                }
+                std::string tag(tree.item_data(item), tree.item_size(item));
+                entries.emplace_back(intern(tag), node);
+                for (int64_t value = item + 1; value < last && !tree.is_tag[value]; ++value) {
+                    uint32_t key = intern(make_key(tag, std::string_view(tree.item_data(value), tree.item_size(value))));
+                    // a value repeated within one node is posted once
+                    if (!posted(entries, key, node)) {
+                        entries.emplace_back(key, node);
+                    }
+                }
+            }
+        }
+        std::stable_sort(entries.begin(), entries.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+        postings.resize(keys.size());
+        for (size_t i = 0; i < entries.size();) {
+            uint32_t key = entries[i].first;
+            Posting& posting = postings[key];
+            posting.offset = bytes.size();
+            int64_t previous = -1;
+            for (; i < entries.size() && entries[i].first == key; ++i) {
+                encode(static_cast<uint64_t>(entries[i].second - previous));
+                previous = entries[i].second;
+                ++posting.count;
+            }
+        }
+        bytes.shrink_to_fit();
+    }
+
+    /**
+     * Nodes in [begin, end) matching `predicate`. Candidates come from the posting list of the tag,
+     * or of (tag, value) when a value is given, and are checked against the value index if it is set.
+     */
+    std::vector<int64_t> lookup(const SGFFlatTree& tree, const SGFTreeQuery::Predicate& predicate, size_t begin, size_t end) const
+    {
+        std::vector<int64_t> result;
+        auto it = keys.find(predicate.match_value ? make_key(predicate.tag, predicate.value) : predicate.tag);
+        if (it == keys.end()) {
+            return result;
+        }
+        bool verify = predicate.match_value && !predicate.any_index;
+        const Posting& posting = postings[it->second];
+        const uint8_t* p = bytes.data() + posting.offset;
+        int64_t node = -1;
+        for (size_t i = 0; i < posting.count; ++i) {
+            node += static_cast<int64_t>(decode(p));
+            if (node < static_cast<int64_t>(begin)) {
+                continue;
+            }
+            if (node >= static_cast<int64_t>(end)) {
+                break;
+            }
+            if (!verify || SGFTreeQuery::matches(tree, node, predicate)) {
+                result.push_back(node);
+            }
+        }
+        return result;
+    }
+
+    size_t num_keys() const
+    {
+        return keys.size();
+    }
+
+    // Bytes taken by the encoded posting lists.
+    size_t posting_bytes() const
+    {
+        return bytes.size();
+    }
+
+private:
+    struct Posting {
+        size_t offset = 0;
+        size_t count = 0;
+    };
+
+    std::unordered_map<std::string, uint32_t> keys;
+    std::vector<Posting> postings;
+    std::vector<uint8_t> bytes;
+
+    // Tags are letters only, so '[' cannot occur in one.
+    static std::string make_key(std::string_view tag, std::string_view value)
+    {
+        std::string key;
+        key.reserve(tag.size() + 1 + value.size());
+        key.append(tag).push_back('[');
+        key.append(value);
+        return key;
+    }
+
+    uint32_t intern(const std::string& key)
+    {
+        return keys.emplace(key, static_cast<uint32_t>(keys.size())).first->second;
+    }
+
+    // A tag repeated later in the node replaces this occurrence, as with `node[tag] = values`.
+    static bool shadowed(const SGFFlatTree& tree, int64_t tag_item, int64_t last)
+    {
+        for (int64_t item = tag_item + 1; item < last; ++item) {
+            if (tree.is_tag[item] && tree.item_size(item) == tree.item_size(tag_item) &&
+                std::memcmp(tree.item_data(item), tree.item_data(tag_item), tree.item_size(item)) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static bool posted(const std::vector<std::pair<uint32_t, int64_t>>& entries, uint32_t key, size_t node)
+    {
+        for (auto it = entries.rbegin(); it != entries.rend() && it->second == static_cast<int64_t>(node); ++it) {
+            if (it->first == key) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void encode(uint64_t value)
+    {
+        while (value >= 0x80) {
+            bytes.push_back(static_cast<uint8_t>(value) | 0x80);
+            value >>= 7;
+        }
+        bytes.push_back(static_cast<uint8_t>(value));
+    }
+
+    static uint64_t decode(const uint8_t*& p)
+    {
+        uint64_t value = 0;
+        for (int shift = 0;; shift += 7) {
+            uint8_t byte = *p++;
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return value;
+            }
+        }
+    }
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "parser.hpp"
+#include <cstring>
+#include <utility>
+#include <vector>
+
+class SGFTreeSerializer {
+public:
+    /**
+     * Convert the tree structure into a compact representation using depth-first traversal.
+     *
+     * @param root The root of the tree.
+     * @param tag_value_string A single continuous string that holds all tag and value pairs in depth-first order.
+     *                         The string is split based on the sizes provided in `tag_value_sizes`.
+     * @param tag_value_sizes An array of sizes corresponding to each tag or value in `tag_value_string`,
+     *                        allowing correct splitting of the string into individual tags and values.
+     * @param is_tag A boolean (char) array indicating whether each segment in `tag_value_string` is a tag (true) or a value (false).
+     *               Size: Same as `tag_value_sizes`.
+     * @param tag_value_count An array that specifies how many tag-value pairs each node contains.
+     *                        Size: the number of nodes in the tree.
+     * @param parent_indices An array that stores the parent index for each node during depth-first traversal.
+     *                       The root node will have a parent index of `-1`. Size: the number of nodes in the tree.
+     */
+    static void serialize(const StringSGFNode* root, char* tag_value_string, size_t tag_value_sizes[], char is_tag[], size_t tag_value_count[], size_t parent_indices[])
+    {
+        size_t offset = 0;
+        size_t tag_value_index = 0;
+        size_t node_index = 0;
+
+        // explicit stack, deep games would overflow the call stack; siblings are pushed below children to keep pre-order
+        std::vector<std::pair<const StringSGFNode*, size_t>> stack;
+        stack.emplace_back(root, static_cast<size_t>(-1));
+        while (!stack.empty()) {
+            auto [node, parent_index] = stack.back();
+            stack.pop_back();
+
+            // Serialize the tag-value pairs of the current node
+            std::memcpy(tag_value_string + offset, node->content.data(), node->content.size());
+            offset += node->content.size();
+
+            // Serialize the tag-value sizes and is_tag array
+            for (size_t i = 0; i < node->tag_value_sizes.size(); i++) {
+                tag_value_sizes[tag_value_index] = node->tag_value_sizes[i];
+                is_tag[tag_value_index] = node->is_tag[i];
+                tag_value_index++;
+            }
+
+            // Serialize the node tag count and parent indices
+            size_t current_node_index = node_index++;
+            tag_value_count[current_node_index] = node->tag_value_sizes.size();
+            parent_indices[current_node_index] = parent_index;
+
+            if (node != root && node->next_sibling != nullptr) {
+                stack.emplace_back(static_cast<const StringSGFNode*>(node->next_sibling), parent_index);
+            }
+            if (node->child != nullptr) {
+                stack.emplace_back(static_cast<const StringSGFNode*>(node->child), current_node_index);
+            }
+        }
+    }
+};
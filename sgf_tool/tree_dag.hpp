@@ -0,0 +1,183 @@
+#pragma once
+
+#include "flat_tree.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/**
+ * An `SGFFlatTree` with identical subtrees stored once, e.g. the transpositions of a merged proof tree.
+ *
+ * Subtrees are hash-consed bottom-up: a node is identified by its items and the ids of its children,
+ * so two subtrees share one node exactly when they are equal, properties and child order included.
+ * Node `i` owns its items as in `SGFFlatTree` and its children are `children[child_offsets[i]]` to
+ * `children[child_offsets[i + 1]]`. A shared node has several parents, so there are no parent links.
+ * Children are numbered before their parents and the root is the last node; `expand` gives back the
+ * plain tree.
+ */
+struct SGFTreeDAG {
+    std::string content;
+    std::vector<int64_t> item_offsets{0};
+    std::vector<uint8_t> is_tag;
+    std::vector<int64_t> node_items{0};
+    std::vector<int64_t> child_offsets{0};
+    std::vector<int64_t> children;
+    std::vector<int64_t> tree_sizes; // nodes of the plain subtree of each node
+
+    size_t num_nodes() const
+    {
+        return tree_sizes.size();
+    }
+
+    size_t num_items() const
+    {
+        return is_tag.size();
+    }
+
+    const char* item_data(size_t item) const
+    {
+        return content.data() + item_offsets[item];
+    }
+
+    size_t item_size(size_t item) const
+    {
+        return item_offsets[item + 1] - item_offsets[item];
+    }
+
+    int64_t root() const
+    {
+        return static_cast<int64_t>(num_nodes()) - 1;
+    }
+
+    // Nodes of the plain tree.
+    size_t num_tree_nodes() const
+    {
+        return tree_sizes.empty() ? 0 : tree_sizes.back();
+    }
+
+    static SGFTreeDAG share(const SGFFlatTree& tree)
+    {
+        SGFTreeDAG dag;
+        size_t n = tree.num_nodes();
+        if (n == 0) {
+            return dag;
+        }
+        // open addressing over node ids, at most half full since there are at most `n` distinct nodes
+        size_t capacity = 2;
+        while (capacity < 2 * n) {
+            capacity *= 2;
+        }
+        std::vector<int64_t> table(capacity, -1);
+        std::vector<uint64_t> hashes;
+        std::vector<int64_t> ids(n);
+        std::vector<int64_t> child_ids;
+        // children follow their parent in pre-order, so they get their id first
+        for (size_t i = n; i-- > 0;) {
+            child_ids.clear();
+            for (int64_t child = tree.first_child[i]; child >= 0; child = tree.next_sibling[child]) {
+                child_ids.push_back(ids[child]);
+            }
+            uint64_t hash = hash_node(tree, i, child_ids);
+            size_t slot = hash & (capacity - 1);
+            for (; table[slot] >= 0; slot = (slot + 1) & (capacity - 1)) {
+                int64_t id = table[slot];
+                if (hashes[id] == hash && dag.equals(id, tree, i, child_ids)) {
+                    break;
+                }
+            }
+            if (table[slot] < 0) {
+                table[slot] = dag.add_node(tree, i, child_ids);
+                hashes.push_back(hash);
+            }
+            ids[i] = table[slot];
+        }
+        return dag;
+    }
+
+    // The plain tree, in pre-order.
+    SGFFlatTree expand() const
+    {
+        SGFFlatTree tree;
+        if (num_nodes() == 0) {
+            return tree;
+        }
+        tree.parent.reserve(num_tree_nodes());
+        std::vector<std::pair<int64_t, int64_t>> stack{{root(), -1}}; // (node, parent in the tree)
+        while (!stack.empty()) {
+            auto [node, parent] = stack.back();
+            stack.pop_back();
+            int64_t index = tree.add_node(parent);
+            for (int64_t item = node_items[node]; item < node_items[node + 1]; ++item) {
+                tree.add_item(std::string_view(item_data(item), item_size(item)), is_tag[item]);
+            }
+            for (int64_t c = child_offsets[node + 1]; c-- > child_offsets[node];) {
+                stack.emplace_back(children[c], index);
+            }
+        }
+        tree.link_children();
+        return tree;
+    }
+
+private:
+    static uint64_t mix(uint64_t hash, uint64_t value)
+    {
+        hash ^= value + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+        return hash;
+    }
+
+    static uint64_t hash_node(const SGFFlatTree& tree, size_t node, const std::vector<int64_t>& child_ids)
+    {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for (int64_t item = tree.node_items[node]; item < tree.node_items[node + 1]; ++item) {
+            hash = mix(hash, tree.item_size(item) * 2 + tree.is_tag[item]);
+            const char* data = tree.item_data(item);
+            for (size_t i = 0; i < tree.item_size(item); ++i) {
+                hash = (hash ^ static_cast<uint8_t>(data[i])) * 0x100000001b3ull;
+            }
+        }
+        for (int64_t id : child_ids) {
+            hash = mix(hash, static_cast<uint64_t>(id));
+        }
+        return mix(hash, child_ids.size());
+    }
+
+    bool equals(int64_t id, const SGFFlatTree& tree, size_t node, const std::vector<int64_t>& child_ids) const
+    {
+        int64_t first = tree.node_items[node];
+        int64_t count = tree.node_items[node + 1] - first;
+        if (node_items[id + 1] - node_items[id] != count ||
+            child_offsets[id + 1] - child_offsets[id] != static_cast<int64_t>(child_ids.size())) {
+            return false;
+        }
+        for (int64_t i = 0; i < count; ++i) {
+            int64_t item = node_items[id] + i;
+            if (is_tag[item] != tree.is_tag[first + i] || item_size(item) != tree.item_size(first + i) ||
+                std::memcmp(item_data(item), tree.item_data(first + i), item_size(item)) != 0) {
+                return false;
+            }
+        }
+        return std::equal(child_ids.begin(), child_ids.end(), children.begin() + child_offsets[id]);
+    }
+
+    int64_t add_node(const SGFFlatTree& tree, size_t node, const std::vector<int64_t>& child_ids)
+    {
+        for (int64_t item = tree.node_items[node]; item < tree.node_items[node + 1]; ++item) {
+            content.append(tree.item_data(item), tree.item_size(item));
+            item_offsets.push_back(content.size());
+            is_tag.push_back(tree.is_tag[item]);
+        }
+        node_items.push_back(is_tag.size());
+        int64_t size = 1;
+        for (int64_t id : child_ids) {
+            children.push_back(id);
+            size += tree_sizes[id];
+        }
+        child_offsets.push_back(children.size());
+        tree_sizes.push_back(size);
+        return static_cast<int64_t>(tree_sizes.size()) - 1;
+    }
+};
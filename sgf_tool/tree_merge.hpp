@@ -0,0 +1,380 @@
+#pragma once
+
+#include "flat_tree.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+enum class SGFMergeRule {
+    FIRST, // keep the value of the first tree having the tag
+    LAST,  // take the value of the last tree having the tag
+    SUM,   // add the first values as numbers, e.g. visit counts
+    MAX,
+    MIN,
+    UNION, // keep every distinct value
+};
+
+/**
+ * How the properties of matched nodes are combined, one rule per tag plus a default rule.
+ *
+ * `combine` is virtual so that statistics needing more than a per-tag rule can be merged by a
+ * subclass. A tag missing from the node merged so far is always added.
+ */
+class SGFMergePolicy {
+public:
+    struct Property {
+        std::string tag;
+        std::vector<std::string> values;
+    };
+
+    explicit SGFMergePolicy(SGFMergeRule default_rule = SGFMergeRule::FIRST) : default_rule(default_rule) {}
+    virtual ~SGFMergePolicy() = default;
+
+    void set_rule(const std::string& tag, SGFMergeRule rule)
+    {
+        rules[tag] = rule;
+    }
+
+    SGFMergeRule rule(const std::string& tag) const
+    {
+        auto it = rules.find(tag);
+        return it != rules.end() ? it->second : default_rule;
+    }
+
+    // Merge the properties of a later tree into `merged`.
+    void merge(std::vector<Property>& merged, std::vector<Property>&& other) const
+    {
+        for (Property& property : other) {
+            auto it = std::find_if(merged.begin(), merged.end(), [&](const Property& p) { return p.tag == property.tag; });
+            if (it == merged.end()) {
+                merged.push_back(std::move(property));
+            } else {
+                combine(it->tag, it->values, property.values);
+            }
+        }
+    }
+
+    // Merge `values` of a later tree into `merged`, the values of `tag` so far.
+    virtual void combine(const std::string& tag, std::vector<std::string>& merged, const std::vector<std::string>& values) const
+    {
+        switch (rule(tag)) {
+            case SGFMergeRule::FIRST:
+                break;
+            case SGFMergeRule::LAST:
+                merged = values;
+                break;
+            case SGFMergeRule::SUM:
+            case SGFMergeRule::MAX:
+            case SGFMergeRule::MIN:
+                combine_numbers(rule(tag), merged, values);
+                break;
+            case SGFMergeRule::UNION:
+                for (const std::string& value : values) {
+                    if (std::find(merged.begin(), merged.end(), value) == merged.end()) {
+                        merged.push_back(value);
+                    }
+                }
+                break;
+        }
+    }
+
+private:
+    SGFMergeRule default_rule;
+    std::unordered_map<std::string, SGFMergeRule> rules;
+
+    // Values that are not numbers keep the merged value unchanged.
+    static void combine_numbers(SGFMergeRule rule, std::vector<std::string>& merged, const std::vector<std::string>& values)
+    {
+        if (merged.empty() || values.empty()) {
+            return;
+        }
+        double a, b;
+        bool integral_a, integral_b;
+        if (!parse_number(merged[0], a, integral_a) || !parse_number(values[0], b, integral_b)) {
+            return;
+        }
+        double result = rule == SGFMergeRule::SUM ? a + b : rule == SGFMergeRule::MAX ? std::max(a, b) : std::min(a, b);
+        char buffer[32];
+        if (integral_a && integral_b) {
+            std::snprintf(buffer, sizeof(buffer), "%lld", static_cast<long long>(result));
+        } else {
+            std::snprintf(buffer, sizeof(buffer), "%.12g", result);
+        }
+        merged[0] = buffer;
+    }
+
+    static bool parse_number(const std::string& text, double& value, bool& integral)
+    {
+        if (text.empty()) {
+            return false;
+        }
+        char* end;
+        value = std::strtod(text.c_str(), &end);
+        integral = text.find_first_of(".eE") == std::string::npos;
+        return *end == '\0';
+    }
+};
+
+/**
+ * K-way merge of flat trees that share their root, e.g. proof trees of several solver shards.
+ *
+ * Children are matched by their key, the values of the key tags (the moves by default), through a
+ * hash map, so matching a node with `k` children across all trees costs O(k). Matched nodes become
+ * one node whose properties come from `SGFMergePolicy`; a node without a match is copied as is.
+ * Siblings sharing a key within one tree are matched the same way, so they are folded into one node
+ * even when a single tree is merged, as `SGFExternalMerger` does. Siblings keep the order of the
+ * first tree they appear in.
+ *
+ * The merged tree is expanded serially until it has enough disjoint subtrees to share between the
+ * threads, which then merge one subtree each into a tree of their own that is appended in order.
+ */
+class SGFTreeMerger {
+public:
+    using Source = std::pair<const SGFFlatTree*, int64_t>;
+
+    SGFTreeMerger(std::vector<std::string> key_tags, const SGFMergePolicy& policy, size_t threads = 0)
+        : key_tags(std::move(key_tags)), policy(policy),
+          threads(threads != 0 ? threads : std::max(1u, std::thread::hardware_concurrency())) {}
+
+    SGFFlatTree merge(const std::vector<const SGFFlatTree*>& trees) const
+    {
+        std::vector<Source> roots;
+        for (const SGFFlatTree* tree : trees) {
+            if (tree->num_nodes() > 0) {
+                roots.emplace_back(tree, 0);
+            }
+        }
+        SGFFlatTree result;
+        if (roots.empty()) {
+            return result;
+        }
+        for (const Source& root : roots) {
+            if (key(root) != key(roots[0])) {
+                throw std::invalid_argument("The roots of the trees differ");
+            }
+        }
+
+        // expand level by level until there are enough subtrees for the threads
+        std::vector<Region> regions(1);
+        regions[0].sources = std::move(roots);
+        std::vector<size_t> level{0};
+        std::vector<size_t> tasks;
+        for (size_t depth = 0; !level.empty(); ++depth) {
+            if (threads <= 1 || level.size() >= threads * 8 || depth == max_serial_depth) {
+                tasks = level;
+                break;
+            }
+            std::vector<size_t> next;
+            for (size_t r : level) {
+                for (std::vector<Source>& group : children(regions[r].sources)) {
+                    regions.emplace_back();
+                    regions.back().sources = std::move(group);
+                    regions[r].children.push_back(regions.size() - 1);
+                    next.push_back(regions.size() - 1);
+                }
+            }
+            level = std::move(next);
+        }
+
+        std::vector<SGFFlatTree> subtrees(tasks.size());
+        for (size_t i = 0; i < tasks.size(); ++i) {
+            regions[tasks[i]].task = static_cast<int64_t>(i);
+        }
+        run_tasks(tasks.size(), [&](size_t i) { subtrees[i] = merge_subtree(regions[tasks[i]].sources); });
+
+        // pre-order over the expanded regions, a task stands for its whole subtree
+        std::vector<std::pair<size_t, int64_t>> stack{{0, -1}};
+        while (!stack.empty()) {
+            auto [r, parent] = stack.back();
+            stack.pop_back();
+            const Region& region = regions[r];
+            if (region.task >= 0) {
+                result.append_subtree(subtrees[region.task], parent);
+                continue;
+            }
+            int64_t index = emit(result, region.sources, parent);
+            for (auto it = region.children.rbegin(); it != region.children.rend(); ++it) {
+                stack.emplace_back(*it, index);
+            }
+        }
+        result.link_children();
+        return result;
+    }
+
+private:
+    struct Region {
+        std::vector<Source> sources;
+        std::vector<size_t> children;
+        int64_t task = -1;
+    };
+
+    static constexpr size_t max_serial_depth = 16;
+
+    std::vector<std::string> key_tags;
+    const SGFMergePolicy& policy;
+    size_t threads;
+
+    template <typename Function>
+    void run_tasks(size_t count, Function function) const
+    {
+        size_t workers = std::min(threads, count);
+        if (workers <= 1) {
+            for (size_t i = 0; i < count; ++i) {
+                function(i);
+            }
+            return;
+        }
+        std::atomic<size_t> next{0};
+        std::vector<std::exception_ptr> errors(workers);
+        std::vector<std::thread> pool;
+        for (size_t w = 0; w < workers; ++w) {
+            pool.emplace_back([&, w]() {
+                try {
+                    for (size_t i = next++; i < count; i = next++) {
+                        function(i);
+                    }
+                } catch (...) {
+                    errors[w] = std::current_exception();
+                }
+            });
+        }
+        for (std::thread& thread : pool) {
+            thread.join();
+        }
+        for (const std::exception_ptr& error : errors) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+    }
+
+    // The whole subtree of matched `sources` as a tree of its own.
+    SGFFlatTree merge_subtree(const std::vector<Source>& sources) const
+    {
+        SGFFlatTree tree;
+        std::vector<std::pair<std::vector<Source>, int64_t>> stack;
+        stack.emplace_back(sources, -1);
+        while (!stack.empty()) {
+            auto [group, parent] = std::move(stack.back());
+            stack.pop_back();
+            int64_t index = emit(tree, group, parent);
+            std::vector<std::vector<Source>> groups = children(group);
+            for (auto it = groups.rbegin(); it != groups.rend(); ++it) {
+                stack.emplace_back(std::move(*it), index);
+            }
+        }
+        return tree;
+    }
+
+    // The children of matched nodes, grouped by key in order of first appearance, siblings of one tree included.
+    std::vector<std::vector<Source>> children(const std::vector<Source>& sources) const
+    {
+        std::vector<std::vector<Source>> groups;
+        if (sources.size() == 1) {
+            // an only child has nothing to be folded with, which spares its key
+            const auto& [tree, node] = sources[0];
+            int64_t child = tree->first_child[node];
+            if (child < 0 || tree->next_sibling[child] < 0) {
+                if (child >= 0) {
+                    groups.push_back({{tree, child}});
+                }
+                return groups;
+            }
+        }
+        std::unordered_map<std::string, size_t> group_of_key;
+        for (const auto& [tree, node] : sources) {
+            for (int64_t child = tree->first_child[node]; child >= 0; child = tree->next_sibling[child]) {
+                auto [it, inserted] = group_of_key.emplace(key({tree, child}), groups.size());
+                if (inserted) {
+                    groups.emplace_back();
+                }
+                groups[it->second].emplace_back(tree, child);
+            }
+        }
+        return groups;
+    }
+
+    // The key tags of a node with their values, e.g. "B[JJ]".
+    std::string key(const Source& source) const
+    {
+        const auto& [tree, node] = source;
+        std::string result;
+        int64_t last = tree->node_items[node + 1];
+        for (const std::string& tag : key_tags) {
+            int64_t tag_item = -1;
+            for (int64_t item = tree->node_items[node]; item < last; ++item) {
+                if (tree->is_tag[item] && item_view(*tree, item) == tag) {
+                    tag_item = item;
+                }
+            }
+            if (tag_item < 0) {
+                continue;
+            }
+            result += tag;
+            for (int64_t item = tag_item + 1; item < last && !tree->is_tag[item]; ++item) {
+                result.append("[").append(item_view(*tree, item)).append("]");
+            }
+        }
+        return result;
+    }
+
+    int64_t emit(SGFFlatTree& out, const std::vector<Source>& sources, int64_t parent) const
+    {
+        int64_t index = out.add_node(parent);
+        if (sources.size() == 1) {
+            const auto& [tree, node] = sources[0];
+            for (int64_t item = tree->node_items[node]; item < tree->node_items[node + 1]; ++item) {
+                out.add_item(item_view(*tree, item), tree->is_tag[item]);
+            }
+            return index;
+        }
+        std::vector<SGFMergePolicy::Property> merged = properties(sources[0]);
+        for (size_t i = 1; i < sources.size(); ++i) {
+            policy.merge(merged, properties(sources[i]));
+        }
+        for (const SGFMergePolicy::Property& property : merged) {
+            out.add_item(property.tag, true);
+            for (const std::string& value : property.values) {
+                out.add_item(value, false);
+            }
+        }
+        return index;
+    }
+
+    // Properties of a node, a repeated tag keeping its first position and its last values.
+    static std::vector<SGFMergePolicy::Property> properties(const Source& source)
+    {
+        const auto& [tree, node] = source;
+        std::vector<SGFMergePolicy::Property> result;
+        size_t current = 0;
+        for (int64_t item = tree->node_items[node]; item < tree->node_items[node + 1]; ++item) {
+            std::string text(item_view(*tree, item));
+            if (!tree->is_tag[item]) {
+                result[current].values.push_back(std::move(text));
+                continue;
+            }
+            auto it = std::find_if(result.begin(), result.end(), [&](const auto& p) { return p.tag == text; });
+            current = it - result.begin();
+            if (it == result.end()) {
+                result.push_back({std::move(text), {}});
+            } else {
+                it->values.clear();
+            }
+        }
+        return result;
+    }
+
+    static std::string_view item_view(const SGFFlatTree& tree, int64_t item)
+    {
+        return std::string_view(tree.item_data(item), tree.item_size(item));
+    }
+};
@@ -0,0 +1,163 @@
+#pragma once
+
+#include "flat_tree.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/**
+ * Traversals and property queries over an `SGFFlatTree`, without recursion.
+ *
+ * Every traversal starts at `root` and fills `order` with node indices and `depths` with their
+ * depth below `root`, in the same order as the matching `Algorithm` function of `utils.py`.
+ */
+class SGFTreeQuery {
+public:
+    struct Predicate {
+        std::string tag;
+        bool match_value = false;  // only test that the tag is present when unset
+        std::string value;
+        int64_t value_index = 0;   // negative counts from the last value, as in Python
+        bool any_index = false;    // matches the value at any index, `value_index` is ignored
+    };
+
+    // One past the last node of the subtree of `root`, which is contiguous in pre-order.
+    static size_t subtree_end(const SGFFlatTree& tree, size_t root)
+    {
+        int64_t node = static_cast<int64_t>(root);
+        while (node >= 0 && tree.next_sibling[node] < 0) {
+            node = tree.parent[node];
+        }
+        return node >= 0 ? static_cast<size_t>(tree.next_sibling[node]) : tree.num_nodes();
+    }
+
+    static void dfs(const SGFFlatTree& tree, size_t root, std::vector<int64_t>& order, std::vector<int64_t>& depths)
+    {
+        size_t end = subtree_end(tree, root);
+        order.resize(end - root);
+        depths.resize(end - root);
+        for (size_t i = root; i < end; ++i) {
+            order[i - root] = i;
+            // parents precede their children
+            depths[i - root] = i == root ? 0 : depths[tree.parent[i] - root] + 1;
+        }
+    }
+
+    static void bfs(const SGFFlatTree& tree, size_t root, std::vector<int64_t>& order, std::vector<int64_t>& depths)
+    {
+        breadth_first(tree, root, false, order, depths);
+    }
+
+    static void bottom_up_dfs(const SGFFlatTree& tree, size_t root, std::vector<int64_t>& order, std::vector<int64_t>& depths)
+    {
+        // post-order: a node is emitted once its last child has been
+        order.clear();
+        depths.clear();
+        std::vector<std::pair<int64_t, int64_t>> stack; // (node, depth), a negated node once its children are pushed
+        stack.emplace_back(static_cast<int64_t>(root), 0);
+        std::vector<int64_t> children;
+        while (!stack.empty()) {
+            auto [node, depth] = stack.back();
+            if (node < 0) {
+                stack.pop_back();
+                order.push_back(~node);
+                depths.push_back(depth);
+                continue;
+            }
+            stack.back().first = ~node;
+            children.clear();
+            for (int64_t child = tree.first_child[node]; child >= 0; child = tree.next_sibling[child]) {
+                children.push_back(child);
+            }
+            for (auto it = children.rbegin(); it != children.rend(); ++it) {
+                stack.emplace_back(*it, depth + 1);
+            }
+        }
+    }
+
+    static void bottom_up_bfs(const SGFFlatTree& tree, size_t root, std::vector<int64_t>& order, std::vector<int64_t>& depths)
+    {
+        breadth_first(tree, root, true, order, depths);
+        std::reverse(order.begin(), order.end());
+        std::reverse(depths.begin(), depths.end());
+    }
+
+    // Nodes of the subtree of `root` matching `predicate`, in pre-order.
+    static std::vector<int64_t> find(const SGFFlatTree& tree, size_t root, const Predicate& predicate)
+    {
+        std::vector<int64_t> result;
+        size_t end = subtree_end(tree, root);
+        for (size_t node = root; node < end; ++node) {
+            if (matches(tree, node, predicate)) {
+                result.push_back(node);
+            }
+        }
+        return result;
+    }
+
+    static bool matches(const SGFFlatTree& tree, size_t node, const Predicate& predicate)
+    {
+        // the last occurrence of a repeated tag wins, as with `node[tag] = values`
+        int64_t tag_item = -1;
+        int64_t last = tree.node_items[node + 1];
+        for (int64_t item = tree.node_items[node]; item < last; ++item) {
+            if (tree.is_tag[item] && equals(tree, item, predicate.tag)) {
+                tag_item = item;
+            }
+        }
+        if (tag_item < 0) {
+            return false;
+        }
+        if (!predicate.match_value) {
+            return true;
+        }
+        int64_t values_end = tag_item + 1;
+        while (values_end < last && !tree.is_tag[values_end]) {
+            ++values_end;
+        }
+        if (predicate.any_index) {
+            for (int64_t item = tag_item + 1; item < values_end; ++item) {
+                if (equals(tree, item, predicate.value)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        int64_t count = values_end - tag_item - 1;
+        int64_t index = predicate.value_index < 0 ? predicate.value_index + count : predicate.value_index;
+        return index >= 0 && index < count && equals(tree, tag_item + 1 + index, predicate.value);
+    }
+
+private:
+    static bool equals(const SGFFlatTree& tree, size_t item, const std::string& text)
+    {
+        return tree.item_size(item) == text.size() && std::memcmp(tree.item_data(item), text.data(), text.size()) == 0;
+    }
+
+    static void breadth_first(const SGFFlatTree& tree, size_t root, bool reverse_children, std::vector<int64_t>& order, std::vector<int64_t>& depths)
+    {
+        order.clear();
+        depths.clear();
+        order.push_back(root);
+        depths.push_back(0);
+        std::vector<int64_t> children;
+        // `order` doubles as the queue
+        for (size_t head = 0; head < order.size(); ++head) {
+            int64_t node = order[head];
+            int64_t depth = depths[head] + 1;
+            children.clear();
+            for (int64_t child = tree.first_child[node]; child >= 0; child = tree.next_sibling[child]) {
+                children.push_back(child);
+            }
+            if (reverse_children) {
+                std::reverse(children.begin(), children.end());
+            }
+            for (int64_t child : children) {
+                order.push_back(child);
+                depths.push_back(depth);
+            }
+        }
+    }
+};
@@ -1,4 +1,5 @@
 from .node import BaseSGFNode
+from .lazy_node import LazySGFNode, LazySGFTree
 import typing
 from collections import deque
 import functools
@@ -6,6 +7,11 @@ import bisect
 import sys
 import time
 
+try:
+    from . import cnative
+except (ImportError, OSError, RuntimeError):
+    cnative = None
+
 
 class DummyTimer:
     def __init__(self, *args, **kwargs):
@@ -85,36 +91,47 @@ class TrackingTimer:
 
 
 class Algorithm:
+    """
+    Tree traversals, all without recursion so that deep games do not hit the recursion limit.
+
+    When the root is an unmodified `LazySGFNode`, the order is computed natively on the flat tree
+    when the traversal starts and only the visited nodes are materialized. Otherwise the tree is
+    walked through `get_children_iter`.
+    """
+
+    @staticmethod
+    def _native_order(root: BaseSGFNode, traversal: str) -> typing.Optional[typing.Iterator[typing.Tuple[BaseSGFNode, int]]]:
+        if not isinstance(root, LazySGFNode) or root.tree.modified:
+            return None
+        tree = root.tree
+        indices, depths = getattr(tree.flat, traversal)(root.index)
+        return ((tree.node(i), d) for i, d in zip(indices, depths))
+
     @staticmethod
     def dfs(root: BaseSGFNode, visit_func: typing.Callable[[BaseSGFNode, int], None]):
         """
         Depth-first search on the tree.
         """
-        Algorithm._dfs(root, visit_func, 0)
-
-    @staticmethod
-    def _dfs(root: BaseSGFNode, visit_func: typing.Callable[[BaseSGFNode, int], None], depth: int):
-        visit_func(root, depth)
-        for child in root.get_children_iter():
-            Algorithm._dfs(child, visit_func, depth + 1)
+        for node, depth in Algorithm.dfs_iterator(root):
+            visit_func(node, depth)
 
     @staticmethod
     def bfs(root: BaseSGFNode, visit_func: typing.Callable[[BaseSGFNode, int], None]):
         """
         Breadth-first search on the tree.
         """
-        queue = deque([(root, 0)])
-        while len(queue) > 0:
-            current, depth = queue.popleft()
-            visit_func(current, depth)
-            for child in current.get_children_iter():
-                queue.append((child, depth + 1))
+        for node, depth in Algorithm.bfs_iterator(root):
+            visit_func(node, depth)
 
     @staticmethod
     def dfs_iterator(root: BaseSGFNode):
         """
         Depth-first search iterator on the tree.
         """
+        native = Algorithm._native_order(root, 'dfs')
+        if native is not None:
+            yield from native
+            return
         stack = [(root, 0)]
         while len(stack) > 0:
             current, depth = stack.pop()
@@ -127,6 +144,10 @@ class Algorithm:
         """
         Breadth-first search iterator on the tree.
         """
+        native = Algorithm._native_order(root, 'bfs')
+        if native is not None:
+            yield from native
+            return
         queue = deque([(root, 0)])
         while len(queue) > 0:
             current, depth = queue.popleft()
@@ -139,27 +160,15 @@ class Algorithm:
         """
         Bottom-up depth-first search on the tree.
         """
-        Algorithm._bottom_up_dfs(root, visit_func, 0)
-
-    @staticmethod
-    def _bottom_up_dfs(root: BaseSGFNode, visit_func: typing.Callable[[BaseSGFNode, int], None], depth: int):
-        for child in list(root.get_children_iter()):
-            Algorithm._bottom_up_dfs(child, visit_func, depth + 1)
-        visit_func(root, depth)
+        for node, depth in Algorithm.bottom_up_dfs_iterator(root):
+            visit_func(node, depth)
 
     @staticmethod
     def bottom_up_bfs(root: BaseSGFNode, visit_func: typing.Callable[[BaseSGFNode, int], None]):
         """
         Bottom-up breadth-first search on the tree.
         """
-        visited_nodes = []
-        queue = deque([(root, 0)])
-        while len(queue) > 0:
-            current, depth = queue.popleft()
-            visited_nodes.append((current, depth))
-            for child in reversed(list(current.get_children_iter())):
-                queue.append((child, depth + 1))
-        for node, depth in reversed(visited_nodes):
+        for node, depth in Algorithm.bottom_up_bfs_iterator(root):
             visit_func(node, depth)
 
     @staticmethod
@@ -167,19 +176,30 @@ class Algorithm:
         """
         Bottom-up depth-first search iterator on the tree.
         """
-        yield from Algorithm._bottom_up_dfs_iterator(root, 0)
-
-    @staticmethod
-    def _bottom_up_dfs_iterator(root: BaseSGFNode, depth: int):
-        for child in list(root.get_children_iter()):
-            yield from Algorithm._bottom_up_dfs_iterator(child, depth + 1)
-        yield root, depth
+        native = Algorithm._native_order(root, 'bottom_up_dfs')
+        if native is not None:
+            yield from native
+            return
+        # the children are listed before the first of them is visited, so visiting may detach nodes
+        stack: typing.List[typing.Tuple[BaseSGFNode, int, bool]] = [(root, 0, False)]
+        while len(stack) > 0:
+            current, depth, expanded = stack.pop()
+            if expanded:
+                yield current, depth
+                continue
+            stack.append((current, depth, True))
+            for child in reversed(list(current.get_children_iter())):
+                stack.append((child, depth + 1, False))
 
     @staticmethod
     def bottom_up_bfs_iterator(root: BaseSGFNode):
         """
         Bottom-up breadth-first search iterator on the tree.
         """
+        native = Algorithm._native_order(root, 'bottom_up_bfs')
+        if native is not None:
+            yield from native
+            return
         visited_nodes = []
         queue = deque([(root, 0)])
         while len(queue) > 0:
@@ -191,19 +211,31 @@ class Algorithm:
             yield node, depth
 
     @staticmethod
-    def find_nodes_with_property(root: BaseSGFNode, tag: str, value: str, value_index: int = 0) -> typing.List[BaseSGFNode]:
+    def find_nodes_with_property(root: BaseSGFNode, tag: str, value: typing.Optional[str] = None,
+                                 value_index: typing.Optional[int] = 0) -> typing.List[BaseSGFNode]:
         """
-        Find nodes with a specific property.
+        Find nodes with a specific property, in depth-first order.
+
+        A node matches if it has `tag` and, unless `value` is None, its value at `value_index` (any of
+        its values if None) equals `value`; a negative `value_index` counts from the last value, as in
+        Python. On an unmodified `LazySGFNode` the predicate is evaluated natively and only the
+        matching nodes are materialized.
         """
-        results = []
+        if isinstance(root, LazySGFNode) and not root.tree.modified:
+            tree = root.tree
+            return [tree.node(i) for i in tree.flat.find(tag, value, value_index, root.index)]
 
-        def visit_func(n, _):
+        results = []
+        for n, _ in Algorithm.dfs_iterator(root):
             if tag in n:
                 values = n[tag]
-                if len(values) > value_index and values[value_index] == value:
+                if value is None:
+                    results.append(n)
+                elif value_index is None:
+                    if value in values:
+                        results.append(n)
+                elif -len(values) <= value_index < len(values) and values[value_index] == value:
                     results.append(n)
-
-        Algorithm.dfs(root, visit_func)
         return results
 
     @staticmethod
@@ -287,3 +319,34 @@ class Algorithm:
                     sorted_nodes[index], child, comparator, merge_func)
             elif index == -1:
                 root.add_child(child.detach())
+
+    @staticmethod
+    def merge_trees(roots: typing.Sequence[BaseSGFNode], key_tags: typing.Sequence[str] = ('B', 'W'),
+                    rules: typing.Optional[typing.Dict[str, str]] = None, default_rule: str = 'first',
+                    threads: int = 0) -> typing.Optional[LazySGFNode]:
+        """
+        Merge trees sharing their root natively and return the root of a new lazy tree.
+
+        Unlike `merge_tree`, no input is modified and any number of trees is merged at once, e.g. the
+        proof trees of all solver shards. Children are matched by the values of `key_tags`, siblings of
+        one tree included, so duplicate moves are folded even in a single tree. The properties of
+        matched nodes are combined per tag by `rules` ('first', 'last', 'sum', 'max', 'min' or 'union',
+        `default_rule` for the other tags). Disjoint subtrees are merged by up to `threads` threads,
+        all cores if 0.
+
+        Unmodified lazy roots are merged straight from their flat trees, other trees are serialized
+        and parsed first.
+
+        Raises:
+            ValueError: If the roots differ in their key tags.
+        """
+        if cnative is None:
+            raise RuntimeError("The native extension is not available")
+        flats = []
+        for root in roots:
+            if isinstance(root, LazySGFNode) and not root.tree.modified and root.index == 0:
+                flats.append(root.tree.flat)
+            else:
+                flats.append(cnative.parse(root.to_sgf()))
+        merged = cnative.merge(flats, tuple(key_tags), rules, default_rule, threads)
+        return LazySGFTree(merged).root()
@@ -0,0 +1,88 @@
+"""
+Solves a position with a coordinator and worker processes (see `Solver.distributed`).
+
+Usage:
+    python solve_distributed.py coordinator [--listen ADDRESS] [--workers N] [--job SGF] [--job-budget N]
+                                            [--top-evaluations N] [--max-jobs N] [--timeout SECONDS]
+                                            [--executable PATH] [--mock-decisive-rate P] [--authkey KEY]
+    python solve_distributed.py worker ADDRESS --authkey KEY [--name NAME]
+
+ADDRESS is HOST:PORT, or the path of a Unix socket. The coordinator starts `--workers` local worker
+processes; workers on other machines join with the `worker` command and the `--authkey` the
+coordinator was given. Without `--authkey` the coordinator makes a random key for its local workers
+and refuses to listen on an address other machines can reach. `--mock-decisive-rate` makes
+every worker answer with the mock engine instead of NCTU6. The coordinator prints one JSON object
+with the result and the statistics of each worker.
+"""
+import argparse
+import dataclasses
+import json
+import os
+import sys
+import time
+
+# Ensure we can import from local directories
+sys.path.append(os.path.dirname(os.path.abspath(__file__)))
+
+from Solver.distributed import Coordinator, WorkerConfig, is_loopback, parse_address, run_worker
+from Solver.mock_engine import MockNCTU6Engine
+from Solver.solver import Solver
+from Solver.types import SearchMode
+
+
+def coordinate(args):
+    config = WorkerConfig(executable_path=args.executable, mock_decisive_rate=args.mock_decisive_rate)
+    if args.mock_decisive_rate is not None:
+        solver = Solver(mode=SearchMode.DFPN, engine=MockNCTU6Engine(decisive_rate=args.mock_decisive_rate))
+    else:
+        solver = Solver(executable_path=args.executable, mode=SearchMode.DFPN)
+    solver.set_job(args.job)
+
+    start = time.perf_counter()
+    authkey = args.authkey.encode() if args.authkey is not None else None
+    with Coordinator(solver, parse_address(args.listen), authkey, config,
+                     job_budget=args.job_budget, top_evaluations=args.top_evaluations) as coordinator:
+        print(f"Listening on {coordinator.address}", file=sys.stderr)
+        coordinator.start_local_workers(args.workers)
+        state = coordinator.solve(max_jobs=args.max_jobs, timeout=args.timeout)
+        print(json.dumps({
+            "job": args.job,
+            "state": state.name,
+            "seconds": time.perf_counter() - start,
+            "jobs": coordinator.jobs,
+            "coordinator_evaluations": solver.stats.evaluations,
+            "tree_nodes": solver.tree.num_nodes,
+            "workers": {name: dataclasses.asdict(stats) for name, stats in coordinator.workers.items()},
+        }))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    commands = parser.add_subparsers(dest="command", required=True)
+    coordinator = commands.add_parser("coordinator")
+    coordinator.add_argument("--listen", default="127.0.0.1:0")
+    coordinator.add_argument("--workers", type=int, default=os.cpu_count() or 1)
+    coordinator.add_argument("--job", default="(;B[JJ];W[IH];W[HI];B[KK];B[LJ])")
+    coordinator.add_argument("--job-budget", type=int, default=200)
+    coordinator.add_argument("--top-evaluations", type=int, default=16)
+    coordinator.add_argument("--max-jobs", type=int, default=None)
+    coordinator.add_argument("--timeout", type=float, default=None)
+    coordinator.add_argument("--executable", default=None)
+    coordinator.add_argument("--mock-decisive-rate", type=float, default=None)
+    coordinator.add_argument("--authkey", default=None)
+    worker = commands.add_parser("worker")
+    worker.add_argument("address")
+    worker.add_argument("--authkey", required=True)
+    worker.add_argument("--name", default=None)
+    args = parser.parse_args()
+
+    if args.command == "coordinator":
+        if args.authkey is None and not is_loopback(parse_address(args.listen)):
+            parser.error(f"--listen {args.listen} is reachable from other machines, give an --authkey")
+        coordinate(args)
+    else:
+        run_worker(parse_address(args.address), args.authkey.encode(), args.name)
+
+
+if __name__ == "__main__":
+    main()